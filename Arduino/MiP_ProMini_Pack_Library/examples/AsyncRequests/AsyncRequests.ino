@@ -0,0 +1,56 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    update()
+    enableAsyncRequests()
+*/
+#include <mip.h>
+
+MiP     mip;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial.println(F("AsyncRequests.ino - Use enableAsyncRequests() and update(). Cycle chest LED colours without waiting on the MiP."));
+
+  mip.enableAsyncRequests();
+}
+
+void loop() {
+  static uint32_t lastChangeTime = 0;
+  static uint32_t loopCount = 0;
+  static uint8_t  colour = 0;
+  uint32_t        currentTime = millis();
+
+  // Send any queued requests to the MiP and process the notifications that it has sent back.
+  mip.update();
+  loopCount++;
+
+  if (currentTime - lastChangeTime >= 1000) {
+    // These requests are queued up and sent from update() so loop() keeps running while they are sent to the MiP.
+    mip.unverifiedWriteChestLED(colour & 1 ? 0xFF : 0x00, colour & 2 ? 0xFF : 0x00, colour & 4 ? 0xFF : 0x00);
+    mip.playSound(MIP_SOUND_MIP_1);
+    colour++;
+
+    Serial.print(F("loop() iterations in the last second: "));
+    Serial.println(loopCount);
+    loopCount = 0;
+    lastChangeTime = currentTime;
+  }
+}
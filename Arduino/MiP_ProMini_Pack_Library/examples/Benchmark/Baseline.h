@@ -0,0 +1,66 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Baseline results used by Benchmark.ino to flag regressions. There is one entry for each benchmark, in the order that
+   Benchmark.ino runs them, first for the clean link and then for the faulty link. An entry with an averageMicros of 0
+   is never flagged.
+
+   These results come from the desktop build in extras/host ("make EXAMPLE=Benchmark run"), where millis() and micros()
+   are driven by a virtual clock, so they only include the time spent waiting on the simulated MiP and not the time
+   taken by the library's own code. Run it again after changing the library to check for regressions there. Results on
+   a board are board specific and will be slower, so paste in the table printed by a run on your own board before using
+   it to check for regressions on that board.
+*/
+#ifndef BASELINE_H_
+#define BASELINE_H_
+
+struct BenchmarkBaseline
+{
+    uint32_t averageMicros;
+    uint16_t bytesPerCall;
+};
+
+static const BenchmarkBaseline g_baseline[] PROGMEM =
+{
+    // Clean link.
+    { 668996, 10 }, // begin() @ 9600
+    {  32660,  8 }, // begin() @ 115200
+    {  16498, 17 }, // writeChestLED()
+    {   8092, 13 }, // readChestLED()
+    {  16547, 16 }, // writeHeadLEDs()
+    {  16247,  7 }, // writeVolume()
+    {   8092,  5 }, // readVolume()
+    {   8124, 11 }, // readDistanceTravelled()
+    {  16443, 11 }, // setUserData()
+    {   8186,  8 }, // getUserData()
+    {   8114, 11 }, // readSoftwareVersion()
+    {   9392, 18 }, // playSound()
+    {   8621,  6 }, // distanceDrive()
+    // Faulty link.
+    { 668954, 10 }, // begin() @ 9600
+    { 426375, 10 }, // begin() @ 115200
+    {  63706, 21 }, // writeChestLED()
+    {  30986, 12 }, // readChestLED()
+    {  90082, 17 }, // writeHeadLEDs()
+    {  41485,  7 }, // writeVolume()
+    {  47832,  5 }, // readVolume()
+    {  42774, 11 }, // readDistanceTravelled()
+    {  41356, 12 }, // setUserData()
+    {   8186,  8 }, // getUserData()
+    {   8114, 11 }, // readSoftwareVersion()
+    {   9392, 18 }, // playSound()
+    {   8621,  6 }, // distanceDrive()
+};
+
+#endif // BASELINE_H_
@@ -0,0 +1,236 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Measures how long MiP library calls take, how many bytes they move over the UART and how often they need to be
+   retried. The calls are made against a simulated MiP so that the results don't depend on the robot. All of the
+   benchmarks are run once with a clean link and then again with some of the MiP's responses dropped or corrupted.
+
+   Each result is compared against the one stored in Baseline.h and flagged as a REGRESSION if it is more than
+   REGRESSION_PERCENT worse. The table printed at the end can be pasted into Baseline.h to update it.
+*/
+#include <mip.h>
+#include <mip_simulator.h>
+#include "Baseline.h"
+
+// Number of times that each call is measured.
+#define ITERATIONS          16
+// Results this much worse than the baseline are flagged as regressions.
+#define REGRESSION_PERCENT  10
+
+// The benchmarks, in the order that they are run and stored in Baseline.h.
+#define BENCHMARK_BEGIN_9600            0
+#define BENCHMARK_BEGIN_115200          1
+#define BENCHMARK_WRITE_CHEST_LED       2
+#define BENCHMARK_READ_CHEST_LED        3
+#define BENCHMARK_WRITE_HEAD_LEDS       4
+#define BENCHMARK_WRITE_VOLUME          5
+#define BENCHMARK_READ_VOLUME           6
+#define BENCHMARK_READ_DISTANCE         7
+#define BENCHMARK_SET_USER_DATA         8
+#define BENCHMARK_GET_USER_DATA         9
+#define BENCHMARK_READ_SOFTWARE_VERSION 10
+#define BENCHMARK_PLAY_SOUND            11
+#define BENCHMARK_DISTANCE_DRIVE        12
+#define BENCHMARK_COUNT                 13
+
+#define PASS_CLEAN  0
+#define PASS_FAULTY 1
+#define PASS_COUNT  2
+
+static_assert(sizeof(g_baseline) / sizeof(g_baseline[0]) == PASS_COUNT * BENCHMARK_COUNT,
+              "Baseline.h doesn't have an entry for each benchmark.");
+
+MiPSimulator  simulatedMiP;
+MiP           mip(simulatedMiP);
+
+uint32_t      samples[ITERATIONS];
+uint32_t      averages[PASS_COUNT * BENCHMARK_COUNT];
+uint16_t      bytesPerCall[PASS_COUNT * BENCHMARK_COUNT];
+uint8_t       regressionCount;
+
+void setup() {
+  Serial.println(F("Benchmark.ino - Measure MiP library calls against a simulated MiP."));
+  Serial.println(F("Benchmark                min(us)  median   max      average  bytes  retries"));
+
+  for (uint8_t pass = 0 ; pass < PASS_COUNT ; pass++) {
+    MiPSimulatorFaults faults;
+    if (pass == PASS_FAULTY) {
+      // Lose about 1 in 10 responses and corrupt the occasional digit.
+      faults.dropResponse = 25;
+      faults.corruptDigit = 2;
+      Serial.println(F("--- Faulty link ---"));
+    } else {
+      Serial.println(F("--- Clean link ---"));
+    }
+    simulatedMiP.setFaults(faults);
+
+    for (uint8_t benchmark = 0 ; benchmark < BENCHMARK_COUNT ; benchmark++) {
+      runBenchmark(pass, benchmark);
+    }
+  }
+
+  Serial.print(F("Regressions: "));
+  Serial.println(regressionCount);
+
+  Serial.println(F("Updated table for Baseline.h:"));
+  for (uint8_t i = 0 ; i < PASS_COUNT * BENCHMARK_COUNT ; i++) {
+    Serial.print(F("    { "));
+    Serial.print(averages[i]);
+    Serial.print(F(", "));
+    Serial.print(bytesPerCall[i]);
+    Serial.println(F(" },"));
+  }
+}
+
+void loop() {
+}
+
+void runBenchmark(uint8_t pass, uint8_t benchmark) {
+  uint32_t totalTime = 0;
+  uint32_t totalBytes = 0;
+  uint16_t totalRetries = 0;
+
+  for (uint8_t iteration = 0 ; iteration < ITERATIONS ; iteration++) {
+    prepareCall(benchmark);
+
+    uint32_t bytesBefore = simulatedMiP.requestByteCount() + simulatedMiP.responseByteCount();
+    uint16_t retriesBefore = mip.retryCount();
+    uint32_t startTime = micros();
+    makeCall(benchmark, iteration);
+    uint32_t elapsedTime = micros() - startTime;
+
+    totalBytes += simulatedMiP.requestByteCount() + simulatedMiP.responseByteCount() - bytesBefore;
+    totalRetries += (uint16_t)(mip.retryCount() - retriesBefore);
+    totalTime += elapsedTime;
+    insertSample(iteration, elapsedTime);
+  }
+
+  uint8_t  index = pass * BENCHMARK_COUNT + benchmark;
+  averages[index] = totalTime / ITERATIONS;
+  bytesPerCall[index] = totalBytes / ITERATIONS;
+
+  printBenchmarkName(benchmark);
+  printColumn(samples[0]);
+  printColumn(samples[ITERATIONS / 2]);
+  printColumn(samples[ITERATIONS - 1]);
+  printColumn(averages[index]);
+  Serial.print(bytesPerCall[index]);
+  Serial.print(F("\t"));
+  Serial.print((float)totalRetries / ITERATIONS);
+
+  BenchmarkBaseline baseline;
+  memcpy_P(&baseline, &g_baseline[index], sizeof(baseline));
+  if (baseline.averageMicros != 0 &&
+      (averages[index] > baseline.averageMicros + baseline.averageMicros / 100 * REGRESSION_PERCENT ||
+       bytesPerCall[index] > baseline.bytesPerCall + baseline.bytesPerCall * REGRESSION_PERCENT / 100)) {
+    Serial.print(F("\tREGRESSION"));
+    regressionCount++;
+  }
+  Serial.println();
+}
+
+// Keeps the samples sorted so that the min, median and max can be read straight out of the array.
+void insertSample(uint8_t count, uint32_t sample) {
+  uint8_t i = count;
+  while (i > 0 && samples[i - 1] > sample) {
+    samples[i] = samples[i - 1];
+    i--;
+  }
+  samples[i] = sample;
+}
+
+// Work done before each call which shouldn't count towards its time.
+void prepareCall(uint8_t benchmark) {
+  switch (benchmark) {
+    case BENCHMARK_BEGIN_9600:
+      mip.end();
+      simulatedMiP.setMiPBaudRate(9600);
+      break;
+    case BENCHMARK_BEGIN_115200:
+      mip.end();
+      simulatedMiP.setMiPBaudRate(115200);
+      break;
+  }
+}
+
+void makeCall(uint8_t benchmark, uint8_t iteration) {
+  switch (benchmark) {
+    case BENCHMARK_BEGIN_9600:
+    case BENCHMARK_BEGIN_115200:
+      mip.begin();
+      break;
+    case BENCHMARK_WRITE_CHEST_LED:
+      // Use a different colour each time so that the write isn't skipped.
+      mip.writeChestLED(iteration * 8, 0xFF - iteration, 0x00);
+      break;
+    case BENCHMARK_READ_CHEST_LED: {
+      MiPChestLED chestLED;
+      mip.readChestLED(chestLED);
+      break;
+    }
+    case BENCHMARK_WRITE_HEAD_LEDS:
+      mip.writeHeadLEDs((MiPHeadLED)(iteration & 3), (MiPHeadLED)(iteration >> 2), MIP_HEAD_LED_ON, MIP_HEAD_LED_OFF);
+      break;
+    case BENCHMARK_WRITE_VOLUME:
+      mip.writeVolume(iteration & 7);
+      break;
+    case BENCHMARK_READ_VOLUME:
+      mip.readVolume();
+      break;
+    case BENCHMARK_READ_DISTANCE:
+      mip.readDistanceTravelled();
+      break;
+    case BENCHMARK_SET_USER_DATA:
+      mip.setUserData(iteration, iteration);
+      break;
+    case BENCHMARK_GET_USER_DATA:
+      mip.getUserData(iteration);
+      break;
+    case BENCHMARK_READ_SOFTWARE_VERSION: {
+      MiPSoftwareVersion software;
+      mip.readSoftwareVersion(software);
+      break;
+    }
+    case BENCHMARK_PLAY_SOUND:
+      mip.playSound(MIP_SOUND_MIP_YEAH);
+      break;
+    case BENCHMARK_DISTANCE_DRIVE:
+      mip.distanceDrive(MIP_DRIVE_FORWARD, 10, MIP_TURN_LEFT, 0);
+      break;
+  }
+}
+
+void printBenchmarkName(uint8_t benchmark) {
+  switch (benchmark) {
+    case BENCHMARK_BEGIN_9600:            Serial.print(F("begin() @ 9600         ")); break;
+    case BENCHMARK_BEGIN_115200:          Serial.print(F("begin() @ 115200       ")); break;
+    case BENCHMARK_WRITE_CHEST_LED:       Serial.print(F("writeChestLED()        ")); break;
+    case BENCHMARK_READ_CHEST_LED:        Serial.print(F("readChestLED()         ")); break;
+    case BENCHMARK_WRITE_HEAD_LEDS:       Serial.print(F("writeHeadLEDs()        ")); break;
+    case BENCHMARK_WRITE_VOLUME:          Serial.print(F("writeVolume()          ")); break;
+    case BENCHMARK_READ_VOLUME:           Serial.print(F("readVolume()           ")); break;
+    case BENCHMARK_READ_DISTANCE:         Serial.print(F("readDistanceTravelled()")); break;
+    case BENCHMARK_SET_USER_DATA:         Serial.print(F("setUserData()          ")); break;
+    case BENCHMARK_GET_USER_DATA:         Serial.print(F("getUserData()          ")); break;
+    case BENCHMARK_READ_SOFTWARE_VERSION: Serial.print(F("readSoftwareVersion()  ")); break;
+    case BENCHMARK_PLAY_SOUND:            Serial.print(F("playSound()            ")); break;
+    case BENCHMARK_DISTANCE_DRIVE:        Serial.print(F("distanceDrive()        ")); break;
+  }
+  Serial.print(F("  "));
+}
+
+void printColumn(uint32_t value) {
+  Serial.print(value);
+  Serial.print(F("\t"));
+}
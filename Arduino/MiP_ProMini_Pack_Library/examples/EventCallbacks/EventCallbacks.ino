@@ -0,0 +1,67 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    onGesture()
+    onClap()
+    onShake()
+    onStatusChange()
+*/
+#include <mip.h>
+
+MiP     mip;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial.println(F("EventCallbacks.ino - Report events as soon as the MiP sends them."));
+
+  mip.onGesture(gestureDetected);
+  mip.onClap(clapsDetected);
+  mip.onShake(shakeDetected);
+  mip.onStatusChange(statusChanged);
+
+  mip.enableGestureMode();
+  mip.enableClapEvents();
+}
+
+void loop() {
+  // The callbacks are called from within update() as the MiP's notifications are received.
+  mip.update();
+}
+
+void gestureDetected(MiPGesture gesture) {
+  Serial.print(F("Gesture: "));
+  Serial.println(gesture);
+}
+
+void clapsDetected(uint8_t clapCount) {
+  Serial.print(F("Claps: "));
+  Serial.println(clapCount);
+}
+
+void shakeDetected() {
+  Serial.println(F("Shake detected!"));
+}
+
+void statusChanged(const MiPStatus& status) {
+  Serial.print(F("Battery: "));
+  Serial.print(status.battery);
+  Serial.print(F("V  Position: "));
+  Serial.println(status.position);
+}
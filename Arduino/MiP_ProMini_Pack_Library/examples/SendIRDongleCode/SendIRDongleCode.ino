@@ -37,7 +37,7 @@ void setup() {
 void loop() {
   uint16_t dongleCode;
 
-  char formattedOutput[14];
+  char formattedOutput[15];
   
   // Try different codes for dongleCode.
   dongleCode = 0x45;
@@ -0,0 +1,60 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example showing how to try out MiP code without a robot by connecting the MiP object to a simulated MiP.
+   Every 10th response from the simulated MiP is lost on average so that the library's error recovery gets a workout.
+*/
+#include <mip.h>
+#include <mip_simulator.h>
+
+MiPSimulator  simulatedMiP;
+MiP           mip(simulatedMiP);
+
+void setup() {
+  MiPSimulatorFaults faults;
+  faults.dropResponse = 25;
+  simulatedMiP.setFaults(faults);
+
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial.println(F("Failed connecting to simulated MiP!"));
+    return;
+  }
+
+  Serial.println(F("Simulator.ino - Control a simulated MiP."));
+
+  mip.enableGestureMode();
+}
+
+void loop() {
+  static uint8_t red = 0;
+
+  mip.writeChestLED(red, 0, 255 - red);
+  red += 15;
+
+  // Pretend that someone waved at the simulated MiP.
+  simulatedMiP.injectGesture(MIP_GESTURE_LEFT);
+  delay(10);
+  while (mip.availableGestureEvents() > 0) {
+    mip.readGestureEvent();
+    Serial.print(F("Gesture detected. Chest LED red = "));
+    Serial.println(red);
+  }
+
+  Serial.print(F("Requests sent = "));
+  Serial.print(simulatedMiP.requestCount());
+  Serial.print(F("  Link health = "));
+  Serial.println(mip.linkHealth());
+  delay(1000);
+}
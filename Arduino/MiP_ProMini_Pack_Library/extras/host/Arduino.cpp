@@ -0,0 +1,176 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Implementation of the desktop stand-in for the Arduino core declared in Arduino.h. */
+#include <stdio.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+
+
+uint32_t       g_hostMicros;
+uint8_t        g_hostPins[HOST_PIN_COUNT];
+HardwareSerial Serial;
+EEPROMClass    EEPROM;
+
+
+size_t Print::write(const uint8_t* pBuffer, size_t size)
+{
+    size_t count = 0;
+    while (size--)
+    {
+        count += write(*pBuffer++);
+    }
+    return count;
+}
+
+size_t Print::print(const __FlashStringHelper* pString)
+{
+    return write((const char*)pString);
+}
+
+size_t Print::print(const char* pString)
+{
+    return write(pString);
+}
+
+size_t Print::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base == DEC)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%ld", value);
+        return write(buffer);
+    }
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", value);
+    return write(buffer);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t Print::println()
+{
+    return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper* pString)
+{
+    return print(pString) + println();
+}
+
+size_t Print::println(const char* pString)
+{
+    return print(pString) + println();
+}
+
+size_t Print::println(char c)
+{
+    return print(c) + println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+    return print(value, base) + println();
+}
+
+size_t Print::println(double value, int digits)
+{
+    return print(value, digits) + println();
+}
+
+
+size_t Stream::readBytes(uint8_t* pBuffer, size_t length)
+{
+    unsigned long startTime = millis();
+    size_t        count = 0;
+
+    while (count < length && millis() - startTime < m_timeout)
+    {
+        int byte = read();
+        if (byte >= 0)
+        {
+            pBuffer[count++] = byte;
+        }
+    }
+    return count;
+}
+
+
+void HardwareSerial::begin(unsigned long baudRate, uint8_t config)
+{
+    // Silence compiler warnings about unused parameters.
+    (void)baudRate;
+    (void)config;
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+    putchar(byte);
+    return 1;
+}
@@ -0,0 +1,188 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Minimal stand-in for the Arduino core which allows the MiP library, the simulated MiP and the example sketches to be
+   built and run on a Linux desktop. Only the parts of the core used by this library and its examples are provided:
+   - millis(), micros(), delay() and delayMicroseconds() run off of a virtual clock. Each call to millis() or micros()
+     advances it by HOST_CLOCK_STEP microseconds so that code which polls the time always makes progress, and the
+     delays advance it by the requested amount without actually sleeping. Results are therefore repeatable and
+     don't depend on how fast the desktop is.
+   - The digital pins just remember the last value written to them.
+   - Serial is a HardwareSerial which sends everything written to it to stdout and never receives anything.
+*/
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+
+// Microseconds that the virtual clock advances on each call to millis() or micros().
+#ifndef HOST_CLOCK_STEP
+    #define HOST_CLOCK_STEP 2
+#endif
+
+// Size of the desktop's stand-in for the AVR's EEPROM, like the ATmega328 on the ProMini.
+#define E2END       0x3FF
+
+#define HIGH        0x1
+#define LOW         0x0
+#define INPUT       0x0
+#define OUTPUT      0x1
+
+#define DEC         10
+#define HEX         16
+
+#define SERIAL_8N1  0x06
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+
+// Time.
+extern uint32_t g_hostMicros;
+
+static inline unsigned long micros()
+{
+    g_hostMicros += HOST_CLOCK_STEP;
+    return g_hostMicros;
+}
+
+static inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+static inline void delayMicroseconds(unsigned int us)
+{
+    g_hostMicros += us;
+}
+
+static inline void delay(unsigned long ms)
+{
+    g_hostMicros += ms * 1000;
+}
+
+
+// Digital pins.
+#define HOST_PIN_COUNT  32
+extern uint8_t g_hostPins[HOST_PIN_COUNT];
+
+static inline void pinMode(uint8_t pin, uint8_t mode)
+{
+    // Silence compiler warnings about unused parameters.
+    (void)pin;
+    (void)mode;
+}
+
+static inline void digitalWrite(uint8_t pin, uint8_t value)
+{
+    g_hostPins[pin % HOST_PIN_COUNT] = value;
+}
+
+static inline int digitalRead(uint8_t pin)
+{
+    return g_hostPins[pin % HOST_PIN_COUNT];
+}
+
+
+// Interrupts.
+static inline void noInterrupts()
+{
+}
+
+static inline void interrupts()
+{
+}
+
+
+// Serial I/O.
+class __FlashStringHelper;
+#define F(STRING) ((const __FlashStringHelper*)(STRING))
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t* pBuffer, size_t size);
+    virtual int    availableForWrite() { return 0; }
+    virtual void   flush() {}
+    size_t         write(const char* pString) { return write((const uint8_t*)pString, strlen(pString)); }
+
+    size_t print(const __FlashStringHelper* pString);
+    size_t print(const char* pString);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println();
+    size_t println(const __FlashStringHelper* pString);
+    size_t println(const char* pString);
+    size_t println(char c);
+    size_t println(unsigned char value, int base = DEC);
+    size_t println(int value, int base = DEC);
+    size_t println(unsigned int value, int base = DEC);
+    size_t println(long value, int base = DEC);
+    size_t println(unsigned long value, int base = DEC);
+    size_t println(double value, int digits = 2);
+};
+
+class Stream : public Print
+{
+public:
+    Stream() : m_timeout(1000) {}
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void   setTimeout(unsigned long timeout) { m_timeout = timeout; }
+    size_t readBytes(uint8_t* pBuffer, size_t length);
+    size_t readBytes(char* pBuffer, size_t length) { return readBytes((uint8_t*)pBuffer, length); }
+
+protected:
+    unsigned long m_timeout;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baudRate, uint8_t config = SERIAL_8N1);
+    void end() {}
+
+    virtual int    available() { return 0; }
+    virtual int    read() { return -1; }
+    virtual int    peek() { return -1; }
+    virtual int    availableForWrite() { return 63; }
+    virtual void   flush();
+    virtual size_t write(uint8_t byte);
+    using Print::write;
+
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif // ARDUINO_H_
@@ -0,0 +1,70 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Desktop stand-in for the Arduino EEPROM library. The EEPROM is kept in RAM, starting out erased to 0xFF like a new
+   AVR, so its contents only last until the program exits.
+*/
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include <Arduino.h>
+
+
+class EEPROMClass
+{
+public:
+    EEPROMClass()
+    {
+        memset(m_data, 0xFF, sizeof(m_data));
+    }
+
+    uint8_t read(int address)
+    {
+        return m_data[address];
+    }
+
+    void write(int address, uint8_t value)
+    {
+        m_data[address] = value;
+    }
+
+    void update(int address, uint8_t value)
+    {
+        m_data[address] = value;
+    }
+
+    uint16_t length()
+    {
+        return sizeof(m_data);
+    }
+
+    template<typename T> T& get(int address, T& object)
+    {
+        memcpy(&object, &m_data[address], sizeof(object));
+        return object;
+    }
+
+    template<typename T> const T& put(int address, const T& object)
+    {
+        memcpy(&m_data[address], &object, sizeof(object));
+        return object;
+    }
+
+protected:
+    uint8_t m_data[E2END + 1];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // EEPROM_H_
@@ -0,0 +1,35 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Desktop stand-in for the AVR's program memory support. Desktop builds have a single address space so PROGMEM data
+   lives in normal memory and can be read directly.
+*/
+#ifndef AVR_PGMSPACE_H_
+#define AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P                       const char*
+
+#define pgm_read_byte(ADDRESS)      (*(const uint8_t*)(ADDRESS))
+#define pgm_read_word(ADDRESS)      (*(const uint16_t*)(ADDRESS))
+#define pgm_read_dword(ADDRESS)     (*(const uint32_t*)(ADDRESS))
+#define pgm_read_ptr(ADDRESS)       (*(const void* const*)(ADDRESS))
+
+#define memcpy_P                    memcpy
+#define strlen_P                    strlen
+
+#endif // AVR_PGMSPACE_H_
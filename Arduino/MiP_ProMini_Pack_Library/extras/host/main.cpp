@@ -0,0 +1,55 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Runs an Arduino sketch on the desktop: setup() is called once and then loop() is called until the virtual clock
+   reaches the number of milliseconds given on the command line (HOST_DEFAULT_RUN_TIME if none is given).
+
+   Usage:
+       sketch [milliseconds]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <Arduino.h>
+
+
+// Milliseconds of virtual time that a sketch runs for when no time is given on the command line.
+#define HOST_DEFAULT_RUN_TIME   10000
+
+
+void setup();
+void loop();
+
+int main(int argc, char** argv)
+{
+    unsigned long runTime = HOST_DEFAULT_RUN_TIME;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "Usage: %s [milliseconds]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2)
+    {
+        runTime = strtoul(argv[1], NULL, 0);
+    }
+
+    setup();
+    while (millis() < runTime)
+    {
+        loop();
+    }
+    Serial.flush();
+
+    return 0;
+}
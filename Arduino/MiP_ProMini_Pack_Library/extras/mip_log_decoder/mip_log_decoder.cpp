@@ -0,0 +1,169 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Desktop tool which turns the binary log records sent by a MiP library built with MIP_LOG_MODE set to MIP_LOG_BINARY
+   back into text. Everything else that the sketch sends, like its own Serial.println() output, is passed through
+   untouched.
+
+   Build:
+       g++ -o mip_log_decoder mip_log_decoder.cpp
+   Usage:
+       mip_log_decoder [input_file]
+   Reads from stdin if no input file is given. To decode straight from the MiP ProMini Pack:
+       stty -F /dev/ttyUSB0 115200 raw -echo && mip_log_decoder /dev/ttyUSB0
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../../src/mip_log.h"
+
+
+struct EventDescription
+{
+    uint8_t     id;
+    uint8_t     args;
+    const char* pFormat;
+};
+
+#define MIP_LOG_TABLE_ENTRY(ID, VALUE, ARGS, FORMAT) { VALUE, ARGS, FORMAT },
+static const EventDescription g_events[] =
+{
+    MIP_LOG_EVENTS(MIP_LOG_TABLE_ENTRY)
+};
+#undef MIP_LOG_TABLE_ENTRY
+
+
+static const EventDescription* findEvent(uint8_t id);
+static bool isValidRecord(const uint8_t* pRecord);
+static void printRecord(const uint8_t* pRecord);
+
+int main(int argc, char** argv)
+{
+    FILE* pInput = stdin;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "Usage: mip_log_decoder [input_file]\n");
+        return 1;
+    }
+    if (argc == 2)
+    {
+        pInput = fopen(argv[1], "rb");
+        if (!pInput)
+        {
+            fprintf(stderr, "error: Failed to open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    // Bytes are passed straight through until a marker shows up. Then they are collected until there is enough for a
+    // whole record. If the collected bytes don't form a valid record then the marker is passed through as is and the
+    // search restarts from the byte after it.
+    uint8_t record[MIP_LOG_RECORD_SIZE];
+    size_t  length = 0;
+    int     byte;
+    while ((byte = fgetc(pInput)) != EOF)
+    {
+        if (length == 0 && byte != MIP_LOG_MARKER)
+        {
+            putchar(byte);
+            continue;
+        }
+
+        record[length++] = byte;
+        while (length == MIP_LOG_RECORD_SIZE)
+        {
+            if (isValidRecord(record))
+            {
+                printRecord(record);
+                length = 0;
+                break;
+            }
+
+            putchar(record[0]);
+            uint8_t* pMarker = (uint8_t*)memchr(&record[1], MIP_LOG_MARKER, length - 1);
+            size_t   skip = pMarker ? pMarker - record : length;
+            fwrite(&record[1], 1, skip - 1, stdout);
+            memmove(record, &record[skip], length - skip);
+            length -= skip;
+        }
+        fflush(stdout);
+    }
+    fwrite(record, 1, length, stdout);
+
+    if (pInput != stdin)
+    {
+        fclose(pInput);
+    }
+    return 0;
+}
+
+static const EventDescription* findEvent(uint8_t id)
+{
+    for (size_t i = 0 ; i < sizeof(g_events) / sizeof(g_events[0]) ; i++)
+    {
+        if (g_events[i].id == id)
+        {
+            return &g_events[i];
+        }
+    }
+    return NULL;
+}
+
+static bool isValidRecord(const uint8_t* pRecord)
+{
+    uint8_t sum = 0;
+
+    for (size_t i = 1 ; i < MIP_LOG_RECORD_SIZE - 1 ; i++)
+    {
+        sum += pRecord[i];
+    }
+    return pRecord[0] == MIP_LOG_MARKER && pRecord[MIP_LOG_RECORD_SIZE - 1] == MIP_LOG_CHECKSUM(sum);
+}
+
+static void printRecord(const uint8_t* pRecord)
+{
+    uint16_t timestamp = pRecord[2] | pRecord[3] << 8;
+    uint16_t arg0 = pRecord[4] | pRecord[5] << 8;
+    uint16_t arg1 = pRecord[6] | pRecord[7] << 8;
+
+    printf("[%5u] ", timestamp);
+    const EventDescription* pEvent = findEvent(pRecord[1]);
+    if (!pEvent)
+    {
+        // Logged by a newer version of the library than this decoder was built against.
+        printf("MiP: Unknown event %u (0x%04X, 0x%04X)\n", pRecord[1], arg0, arg1);
+        return;
+    }
+
+    switch (pEvent->args)
+    {
+    case MIP_LOG_ARGS_NONE:
+        fputs(pEvent->pFormat, stdout);
+        break;
+    case MIP_LOG_ARGS_U16:
+        printf(pEvent->pFormat, (unsigned int)arg0);
+        break;
+    case MIP_LOG_ARGS_U16_U16:
+        printf(pEvent->pFormat, (unsigned int)arg0, (unsigned int)arg1);
+        break;
+    case MIP_LOG_ARGS_U32:
+        printf(pEvent->pFormat, (unsigned long)arg1 << 16 | arg0);
+        break;
+    case MIP_LOG_ARGS_I16:
+        printf(pEvent->pFormat, (int)(int16_t)arg0);
+        break;
+    }
+    printf("\n");
+}
@@ -0,0 +1,215 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Measures how long the MiP library takes to decode the hex text sent by the MiP, in nanoseconds of desktop time per
+   received digit. The stream of status notifications is decoded twice: once with all of it waiting to be read, which
+   lets the decoder take its fast path through whole frames, and once with just one digit showing up for each call to
+   update(), which makes it resume a partial frame on every call.
+
+   The digit conversion on its own is also timed against the range comparisons which the library used before
+   mipParseHexDigit() switched to a lookup table, both run over the same buffer of digits.
+*/
+#include <mip_protocol.h>
+#include "mip_test.h"
+
+
+// Number of status notifications decoded for each measurement.
+#define NOTIFICATION_COUNT  200000
+// Hex text of each status notification, alternating between two positions so that each one is a change.
+#define NOTIFICATION_TEXT   "794D00794D02"
+#define NOTIFICATION_DIGITS (sizeof(NOTIFICATION_TEXT) - 1)
+// Size of the buffer of digits converted by the digit conversion kernels and how many times it is converted.
+#define KERNEL_BUFFER_SIZE  4096
+#define KERNEL_PASSES       5000
+
+
+// Simulated MiP which, once start() has been called, sends the same text over and over as fast as the library can read it.
+class RepeatingMiP : public MiPSimulator
+{
+public:
+    RepeatingMiP()
+    {
+        setStatusInterval(0);
+        m_remaining = 0;
+        m_burstSize = 0;
+    }
+
+    // Sends digitCount digits of NOTIFICATION_TEXT, making no more than burstSize of them available to each call to
+    // update().
+    void start(uint32_t digitCount, uint32_t burstSize)
+    {
+        m_remaining = digitCount;
+        m_burstSize = burstSize;
+        m_index = 0;
+        m_burstLeft = 0;
+    }
+
+    void startBurst()
+    {
+        m_burstLeft = m_burstSize;
+    }
+
+    uint32_t remaining()
+    {
+        return m_remaining;
+    }
+
+    virtual int available()
+    {
+        if (m_burstSize == 0)
+        {
+            // Not started yet so act like a normal simulated MiP, which lets begin() connect to it.
+            return MiPSimulator::available();
+        }
+        return m_remaining < m_burstLeft ? m_remaining : m_burstLeft;
+    }
+
+    virtual int read()
+    {
+        if (m_burstSize == 0)
+        {
+            return MiPSimulator::read();
+        }
+        if (available() == 0)
+        {
+            return -1;
+        }
+        uint8_t digit = NOTIFICATION_TEXT[m_index++];
+        if (m_index == NOTIFICATION_DIGITS)
+        {
+            m_index = 0;
+        }
+        m_remaining--;
+        m_burstLeft--;
+        return digit;
+    }
+
+protected:
+    uint32_t m_remaining;
+    uint32_t m_burstSize;
+    uint32_t m_burstLeft;
+    uint8_t  m_index;
+};
+
+static RepeatingMiP g_repeatingMiP;
+static MiP          g_mip(g_repeatingMiP);
+static uint32_t     g_statusChangeCount;
+
+
+static void statusChanged(const MiPStatus& status)
+{
+    (void)status;
+    g_statusChangeCount++;
+}
+
+// The range compare version of parseHexDigit() which the library used before mipParseHexDigit(), kept as the reference
+// for the lookup table. It is kept out of line like mipParseHexDigit() so that both pay for a call.
+static __attribute__((noinline)) uint8_t referenceParseHexDigit(uint8_t digit)
+{
+    if (digit >= '0' && digit <= '9')
+    {
+        return digit - '0';
+    }
+    else if (digit >= 'a' && digit <= 'f')
+    {
+        return digit - 'a' + 10;
+    }
+    else if (digit >= 'A' && digit <= 'F')
+    {
+        return digit - 'A' + 10;
+    }
+    else
+    {
+        return MIP_INVALID_HEX_DIGIT;
+    }
+}
+
+// Converts every digit in pDigits KERNEL_PASSES times with pParse, returning the elapsed nanoseconds and the sum of the
+// converted values in *pSum so that the work can't be optimized away.
+static uint64_t runKernel(uint8_t (*pParse)(uint8_t), const uint8_t* pDigits, uint32_t* pSum)
+{
+    uint32_t sum = 0;
+    uint64_t startTime = benchmarkNanoseconds();
+    for (uint32_t pass = 0 ; pass < KERNEL_PASSES ; pass++)
+    {
+        for (uint32_t i = 0 ; i < KERNEL_BUFFER_SIZE ; i++)
+        {
+            sum += pParse(pDigits[i]);
+        }
+    }
+    uint64_t elapsedTime = benchmarkNanoseconds() - startTime;
+    *pSum = sum;
+    return elapsedTime;
+}
+
+static void runKernelBenchmark()
+{
+    static uint8_t digits[KERNEL_BUFFER_SIZE];
+    uint32_t       digitCount = (uint32_t)KERNEL_BUFFER_SIZE * KERNEL_PASSES;
+    uint32_t       referenceSum;
+    uint32_t       tableSum;
+
+    for (uint32_t i = 0 ; i < KERNEL_BUFFER_SIZE ; i++)
+    {
+        digits[i] = NOTIFICATION_TEXT[i % NOTIFICATION_DIGITS];
+    }
+
+    // Warm up the caches and branch predictors the same way for both before timing them.
+    runKernel(referenceParseHexDigit, digits, &referenceSum);
+    runKernel(mipParseHexDigit, digits, &tableSum);
+    uint64_t referenceTime = runKernel(referenceParseHexDigit, digits, &referenceSum);
+    uint64_t tableTime = runKernel(mipParseHexDigit, digits, &tableSum);
+
+    printf("%-28s %8.2f ns/digit\n", "Range compare (reference)", (double)referenceTime / digitCount);
+    printf("%-28s %8.2f ns/digit\n", "mipParseHexDigit() table", (double)tableTime / digitCount);
+    printf("%-28s %8.2fx\n", "Reference / table", (double)referenceTime / tableTime);
+    CHECK(tableSum == referenceSum);
+}
+
+static void runBenchmark(const char* pName, uint32_t burstSize)
+{
+    uint32_t digitCount = NOTIFICATION_COUNT / 2 * NOTIFICATION_DIGITS;
+
+    g_statusChangeCount = 0;
+    g_mip.clearSkippedByteCount();
+    g_repeatingMiP.start(digitCount, burstSize);
+    uint64_t startTime = benchmarkNanoseconds();
+    while (g_repeatingMiP.remaining() > 0)
+    {
+        g_repeatingMiP.startBurst();
+        g_mip.update();
+    }
+    uint64_t elapsedTime = benchmarkNanoseconds() - startTime;
+
+    printf("%-28s %8.2f ns/digit  %8.2f ns/frame\n", pName,
+           (double)elapsedTime / digitCount, (double)elapsedTime / NOTIFICATION_COUNT);
+    CHECK(g_statusChangeCount == NOTIFICATION_COUNT);
+    CHECK(g_mip.skippedByteCount() == 0);
+}
+
+int main()
+{
+    if (!CHECK(g_mip.begin()))
+    {
+        return testResult("bench_hex_decoder");
+    }
+    g_mip.onStatusChange(statusChanged);
+
+    runBenchmark("All digits waiting", 0xFFFFFFFF);
+    runBenchmark("Whole frame per update()", 6);
+    runBenchmark("One digit per update()", 1);
+    runKernelBenchmark();
+
+    return testResult("bench_hex_decoder");
+}
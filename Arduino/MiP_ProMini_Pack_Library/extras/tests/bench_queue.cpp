@@ -0,0 +1,78 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Measures how long CircularQueue and SpscQueue take to push and pop, in nanoseconds of desktop time per operation.
+   Power of 2 sizes, which mask their indices, are compared against a size which has to wrap its indices with a compare
+   instead.
+*/
+#include <stdio.h>
+#include <queue.h>
+#include "mip_test.h"
+
+
+// Number of operations timed for each queue.
+#define OPERATION_COUNT 50000000
+
+
+// Event stored in the queues, like the timestamped events that the MiP class queues up.
+struct QueuedEvent
+{
+    uint8_t  value;
+    uint16_t arrivalTime;
+};
+
+template<class QueueType>
+static void runBenchmark(const char* pName, QueueType& queue)
+{
+    volatile uint8_t sink = 0;
+    QueuedEvent      event = { 0, 0 };
+
+    // Keep the queue half full so that its indices wrap around regularly without it ever overflowing.
+    uint64_t startTime = benchmarkNanoseconds();
+    for (uint32_t i = 0 ; i < OPERATION_COUNT / 2 ; i++)
+    {
+        event.value = (uint8_t)i;
+        queue.push(event);
+        if (queue.available() > 3)
+        {
+            queue.pop(event);
+            sink = event.value;
+        }
+    }
+    while (queue.pop(event))
+    {
+        sink = event.value;
+    }
+    uint64_t elapsedTime = benchmarkNanoseconds() - startTime;
+    (void)sink;
+
+    printf("%-32s %6.3f ns/operation\n", pName, (double)elapsedTime / OPERATION_COUNT);
+}
+
+int main()
+{
+    static CircularQueue<QueuedEvent, 8>  circularQueue8;
+    static CircularQueue<QueuedEvent, 64> circularQueue64;
+    static CircularQueue<QueuedEvent, 6>  circularQueue6;
+    static SpscQueue<QueuedEvent, 8>      spscQueue8;
+    static SpscQueue<QueuedEvent, 64>     spscQueue64;
+
+    runBenchmark("CircularQueue<QueuedEvent, 8>", circularQueue8);
+    runBenchmark("CircularQueue<QueuedEvent, 64>", circularQueue64);
+    runBenchmark("CircularQueue<QueuedEvent, 6>", circularQueue6);
+    runBenchmark("SpscQueue<QueuedEvent, 8>", spscQueue8);
+    runBenchmark("SpscQueue<QueuedEvent, 64>", spscQueue64);
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Helpers shared by the desktop tests of the MiP library. They are built against the Arduino core stand-in in
+   extras/host by the Makefile in this directory.
+*/
+#ifndef MIP_TEST_H_
+#define MIP_TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include <mip.h>
+#include <mip_simulator.h>
+
+// The tests report their results on stdout and not through the MiP library's redirection of Serial.
+#undef Serial
+
+
+// Checks that EXPRESSION is true, reporting where it wasn't and counting the failure otherwise. The test's main()
+// returns testResult() so that the Makefile can tell whether it passed.
+#define CHECK(EXPRESSION) checkExpression((EXPRESSION), #EXPRESSION, __FILE__, __LINE__)
+
+static int g_failureCount;
+
+static inline bool checkExpression(bool isTrue, const char* pExpression, const char* pFile, int line)
+{
+    if (!isTrue)
+    {
+        printf("%s:%d: CHECK(%s) failed\n", pFile, line, pExpression);
+        g_failureCount++;
+    }
+    return isTrue;
+}
+
+static inline int testResult(const char* pTestName)
+{
+    printf("%s: %s (%d failures)\n", pTestName, g_failureCount == 0 ? "PASSED" : "FAILED", g_failureCount);
+    return g_failureCount == 0 ? 0 : 1;
+}
+
+
+// Returns the time used by benchmarks in nanoseconds. Unlike micros(), this is the desktop's real clock.
+static inline uint64_t benchmarkNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+// Simulated MiP which also sends text handed to it by the test, ahead of anything that the simulator itself sends.
+// The text is given to the MiP library in the pieces passed to receive(), each released a set amount of time after the
+// one before it, so that tests can control exactly how the MiP's output is split up between reads.
+class ScriptedMiP : public MiPSimulator
+{
+public:
+    ScriptedMiP()
+    {
+        // Periodic status notifications would get mixed in with the test's own.
+        setStatusInterval(0);
+        m_lastReleaseTime = micros();
+    }
+
+    // Queues up pText to be received from the MiP delayMicros after the previously queued piece of text.
+    void receive(const char* pText, uint32_t delayMicros = 0)
+    {
+        uint32_t currentTime = micros();
+        if (m_pieces.empty() || (int32_t)(m_lastReleaseTime - currentTime) < 0)
+        {
+            m_lastReleaseTime = currentTime;
+        }
+        m_lastReleaseTime += delayMicros;
+
+        Piece piece = { m_lastReleaseTime, pText };
+        m_pieces.push_back(piece);
+    }
+
+    // Returns true once all of the queued up text has been read by the MiP library.
+    bool isScriptDone()
+    {
+        return m_pieces.empty();
+    }
+
+    virtual int available()
+    {
+        if (!m_pieces.empty())
+        {
+            // Only the first piece is available until it has all been read.
+            const Piece& piece = m_pieces.front();
+            if ((int32_t)(micros() - piece.releaseTime) < 0)
+            {
+                return 0;
+            }
+            return strlen(piece.pText);
+        }
+        return MiPSimulator::available();
+    }
+
+    virtual int read()
+    {
+        if (!m_pieces.empty())
+        {
+            if (available() == 0)
+            {
+                return -1;
+            }
+            Piece& piece = m_pieces.front();
+            uint8_t byte = *piece.pText++;
+            if (*piece.pText == '\0')
+            {
+                m_pieces.pop_front();
+            }
+            return byte;
+        }
+        return MiPSimulator::read();
+    }
+
+protected:
+    struct Piece
+    {
+        uint32_t    releaseTime;
+        const char* pText;
+    };
+
+    std::deque<Piece> m_pieces;
+    uint32_t          m_lastReleaseTime;
+};
+
+#endif // MIP_TEST_H_
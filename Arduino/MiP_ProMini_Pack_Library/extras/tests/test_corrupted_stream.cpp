@@ -0,0 +1,124 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Checks that the MiP library's decoder survives corrupted data from the MiP, resynchronizing on the next valid frame
+   without losing it.
+*/
+#include "mip_test.h"
+
+
+static ScriptedMiP g_scriptedMiP;
+static MiP         g_mip(g_scriptedMiP);
+
+
+static void updateUntilScriptDone()
+{
+    while (!g_scriptedMiP.isScriptDone())
+    {
+        g_mip.update();
+        delayMicroseconds(50);
+    }
+    g_mip.update();
+}
+
+static void testCorruptFrameArrivingWithNextFrame()
+{
+    // Status notification with an invalid position, followed straight away by a gesture. All of it is waiting to be
+    // read at once so the decoder takes its fast path through the status notification before rejecting it.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("794D0F0A0B");
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 1);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_RIGHT);
+    CHECK(g_mip.skippedByteCount() == 6);
+}
+
+static void testCorruptFrameBeforeNextFrameArrives()
+{
+    // Same as above, but the gesture only shows up after the decoder has already rejected the status notification.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("794D0F");
+    g_scriptedMiP.receive("0A0B", 500);
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 1);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_RIGHT);
+    CHECK(g_mip.skippedByteCount() == 6);
+}
+
+static void testJunkBetweenFrames()
+{
+    // Characters which aren't hex digits and bytes which can't start a frame.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("0A0C\r\nxx550A0D");
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 2);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_CENTER_SWEEP_LEFT);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_CENTER_SWEEP_RIGHT);
+    CHECK(g_mip.skippedByteCount() == 6);
+}
+
+static void testCorruptDigitInResponse()
+{
+    // The first response has a corrupted digit, so the library should retry and use the simulator's response instead.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("16G5", 5000);
+    uint8_t volume = g_mip.readVolume();
+
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(volume == MIP_VOLUME_7);
+    CHECK(g_mip.skippedByteCount() > 0);
+}
+
+static void testSurvivesRandomCorruption()
+{
+    // Let the simulated MiP corrupt its own output and make sure that verified calls still get through.
+    MiPSimulatorFaults faults;
+    faults.corruptDigit = 8;
+    faults.junkByte = 32;
+    faults.seed = 5;
+    g_scriptedMiP.setFaults(faults);
+
+    uint8_t successCount = 0;
+    for (uint8_t i = 0 ; i < 32 ; i++)
+    {
+        g_mip.writeChestLED(i * 8, 0x00, 0xFF - i * 8);
+        if (g_mip.lastCallResult() == MIP_ERROR_NONE)
+        {
+            successCount++;
+        }
+    }
+    g_scriptedMiP.setFaults(MiPSimulatorFaults());
+
+    CHECK(successCount == 32);
+    CHECK(g_mip.skippedByteCount() > 0);
+}
+
+int main()
+{
+    if (!CHECK(g_mip.begin()))
+    {
+        return testResult("test_corrupted_stream");
+    }
+
+    testCorruptFrameArrivingWithNextFrame();
+    testCorruptFrameBeforeNextFrameArrives();
+    testJunkBetweenFrames();
+    testCorruptDigitInResponse();
+    testSurvivesRandomCorruption();
+
+    return testResult("test_corrupted_stream");
+}
@@ -0,0 +1,159 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Checks that the MiP library's resumable hex decoder puts frames back together no matter how the MiP's output is split
+   up between reads, including a digit at a time and across frame boundaries.
+*/
+#include "mip_test.h"
+
+
+static ScriptedMiP g_scriptedMiP;
+static MiP         g_mip(g_scriptedMiP);
+static MiPStatus   g_lastStatus;
+static uint8_t     g_statusChangeCount;
+
+
+// Calls update() until all of the scripted text has been read, plus a little longer to let the decoder finish up.
+static void updateUntilScriptDone()
+{
+    while (!g_scriptedMiP.isScriptDone())
+    {
+        g_mip.update();
+        delayMicroseconds(50);
+    }
+    g_mip.update();
+}
+
+static void statusChanged(const MiPStatus& status)
+{
+    g_lastStatus = status;
+    g_statusChangeCount++;
+}
+
+static void testNotificationDeliveredOneDigitAtATime()
+{
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("0");
+    g_scriptedMiP.receive("A", 200);
+    g_scriptedMiP.receive("0", 200);
+    g_scriptedMiP.receive("B", 200);
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 1);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_RIGHT);
+    CHECK(g_mip.skippedByteCount() == 0);
+}
+
+static void testNotificationSplitUnevenly()
+{
+    g_mip.clearSkippedByteCount();
+    g_mip.onStatusChange(statusChanged);
+    g_statusChangeCount = 0;
+    g_scriptedMiP.receive("7");
+    g_scriptedMiP.receive("94", 300);
+    g_scriptedMiP.receive("D", 300);
+    g_scriptedMiP.receive("00", 300);
+    updateUntilScriptDone();
+    g_mip.onStatusChange(NULL);
+
+    CHECK(g_statusChangeCount == 1);
+    CHECK(g_lastStatus.position == MIP_POSITION_ON_BACK);
+    CHECK(g_mip.skippedByteCount() == 0);
+}
+
+static void testFramesSplitAcrossPieces()
+{
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("0A0B0");
+    g_scriptedMiP.receive("A0C0A", 200);
+    g_scriptedMiP.receive("0D", 200);
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 3);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_RIGHT);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_CENTER_SWEEP_LEFT);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_CENTER_SWEEP_RIGHT);
+    CHECK(g_mip.skippedByteCount() == 0);
+}
+
+static void testResponseDeliveredInPieces()
+{
+    // Only the scripted response should make it back to the library.
+    MiPSimulatorFaults faults;
+    faults.dropResponse = 255;
+    g_scriptedMiP.setFaults(faults);
+
+    // Leave enough time for the request to be sent before the response starts to arrive.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("1", 5000);
+    g_scriptedMiP.receive("6", 300);
+    g_scriptedMiP.receive("0", 300);
+    g_scriptedMiP.receive("5", 300);
+    uint8_t volume = g_mip.readVolume();
+
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(volume == 5);
+    CHECK(g_mip.skippedByteCount() == 0);
+    CHECK(g_scriptedMiP.isScriptDone());
+
+    g_scriptedMiP.setFaults(MiPSimulatorFaults());
+}
+
+static void testStalledFrameIsDropped()
+{
+    // The rest of the first frame never shows up so it should be thrown away once it times out.
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("0A");
+    g_scriptedMiP.receive("0A0E", 150000);
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 1);
+    CHECK(g_mip.readGestureEvent() == MIP_GESTURE_CENTER_HOLD);
+    CHECK(g_mip.skippedByteCount() == 2);
+}
+
+static void testEventStampedWithStartOfFrame()
+{
+    // The rest of the notification shows up later but the event should be stamped with when its first digit was read.
+    uint16_t arrivalTime;
+    g_mip.clearSkippedByteCount();
+    g_scriptedMiP.receive("0");
+    g_scriptedMiP.receive("A", 200);
+    uint16_t startTime = (uint16_t)millis();
+    g_scriptedMiP.receive("0B", 50000);
+    updateUntilScriptDone();
+
+    CHECK(g_mip.availableGestureEvents() == 1);
+    CHECK(g_mip.readGestureEvent(arrivalTime) == MIP_GESTURE_RIGHT);
+    CHECK((uint16_t)(arrivalTime - startTime) <= 1);
+    CHECK((uint16_t)((uint16_t)millis() - arrivalTime) >= 50);
+    CHECK(g_mip.skippedByteCount() == 0);
+}
+
+int main()
+{
+    if (!CHECK(g_mip.begin()))
+    {
+        return testResult("test_fragmented_stream");
+    }
+
+    testNotificationDeliveredOneDigitAtATime();
+    testNotificationSplitUnevenly();
+    testFramesSplitAcrossPieces();
+    testResponseDeliveredInPieces();
+    testStalledFrameIsDropped();
+    testEventStampedWithStartOfFrame();
+
+    return testResult("test_fragmented_stream");
+}
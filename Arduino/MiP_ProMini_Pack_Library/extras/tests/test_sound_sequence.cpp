@@ -0,0 +1,182 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Checks that playSoundSequence() sends long sequences to the simulated MiP 8 entries at a time, with each group sent
+   once the estimated duration of the group before it has passed.
+*/
+#include "mip_test.h"
+
+
+// The library times each group from when it hands the request to the UART while the simulated MiP records when the
+// last byte arrives, so a group can look up to a transmit time plus a millisecond of rounding early. It can also be
+// held up by the gap that the library leaves between requests.
+#define CHUNK_EARLY_TOLERANCE 3000
+#define CHUNK_LATE_TOLERANCE  20000
+
+static MiPSimulator g_simulatedMiP;
+static MiP          g_mip(g_simulatedMiP);
+
+MIP_SOUND_SEQUENCE(g_longSequence,
+                   { MIP_VOLUME_4 },
+                   { MIP_SOUND_MIP_HI_CONFIDENT, 300 },
+                   { MIP_SOUND_MIP_1 },
+                   { MIP_SOUND_MIP_2, 90 },
+                   { MIP_SOUND_MIP_3 },
+                   { MIP_SOUND_MOOD_HAPPY, 600 },
+                   { MIP_SOUND_MIP_YO },
+                   { MIP_SOUND_MIP_GO },
+                   { MIP_SOUND_MIP_BYE, 150 },
+                   { MIP_SOUND_MIP_YEAH });
+
+MIP_SOUND_SEQUENCE(g_shortSequence,
+                   { MIP_SOUND_MIP_HUH, 60 },
+                   { MIP_SOUND_MIP_GO });
+
+
+// Returns the number of microseconds that the library expects entries first to last-1 of a sequence to take to play.
+static uint32_t expectedDuration(const MiPSoundEntry* pSequence, uint8_t first, uint8_t last)
+{
+    uint32_t duration = 0;
+    for (uint8_t i = first ; i < last ; i++)
+    {
+        const MiPSoundEntry& entry = pSequence[i];
+        if (entry.sound < MIP_SOUND_VOLUME_OFF)
+        {
+            duration += g_mip.estimateSoundDuration((MiPSoundIndex)entry.sound);
+        }
+        duration += entry.delay * 30;
+    }
+    return duration * 1000;
+}
+
+// Checks that the last sound list received by the simulated MiP holds entries first to last-1 of the sequence, padded
+// out with mute sounds.
+static void checkLastSoundList(const MiPSoundEntry* pSequence, uint8_t first, uint8_t last)
+{
+    const uint8_t* pList = g_simulatedMiP.lastSoundList();
+    for (uint8_t i = 0 ; i < 8 ; i++)
+    {
+        if (first + i < last)
+        {
+            CHECK(pList[i * 2] == pSequence[first + i].sound);
+            CHECK(pList[i * 2 + 1] == pSequence[first + i].delay);
+        }
+        else
+        {
+            CHECK(pList[i * 2] == MIP_SOUND_SHORT_MUTE_FOR_STOP);
+            CHECK(pList[i * 2 + 1] == 0);
+        }
+    }
+    CHECK(pList[16] == 0);
+}
+
+// Calls update() until the simulated MiP has received soundListCount sound lists or the sequence stops playing.
+static void updateUntilSoundListCount(uint16_t soundListCount)
+{
+    uint32_t startTime = micros();
+    while (g_simulatedMiP.soundListCount() < soundListCount && g_mip.isSoundSequencePlaying() &&
+           micros() - startTime < 60000000)
+    {
+        g_mip.update();
+        delayMicroseconds(500);
+    }
+}
+
+static void testLongSequenceSentInTimedChunks()
+{
+    const uint8_t length = sizeof(g_longSequence) / sizeof(g_longSequence[0]);
+    uint16_t      startCount = g_simulatedMiP.soundListCount();
+
+    g_mip.playSoundSequence(g_longSequence);
+    CHECK(g_mip.isSoundSequencePlaying());
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 1);
+    checkLastSoundList(g_longSequence, 0, 8);
+    uint32_t firstChunkTime = g_simulatedMiP.lastSoundListTime();
+
+    // The rest of the sequence shouldn't be sent until the first 8 entries should be done playing.
+    uint32_t firstChunkDuration = expectedDuration(g_longSequence, 0, 8);
+    updateUntilSoundListCount(startCount + 2);
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 2);
+    checkLastSoundList(g_longSequence, 8, length);
+    uint32_t gap = g_simulatedMiP.lastSoundListTime() - firstChunkTime;
+    CHECK(gap >= firstChunkDuration - CHUNK_EARLY_TOLERANCE);
+    CHECK(gap <= firstChunkDuration + CHUNK_LATE_TOLERANCE);
+
+    // The sequence is done once the last group should have finished and nothing more is sent.
+    uint32_t secondChunkTime = g_simulatedMiP.lastSoundListTime();
+    uint32_t secondChunkDuration = expectedDuration(g_longSequence, 8, length);
+    updateUntilSoundListCount(startCount + 3);
+    CHECK(!g_mip.isSoundSequencePlaying());
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 2);
+    uint32_t doneTime = micros() - secondChunkTime;
+    CHECK(doneTime >= secondChunkDuration - CHUNK_EARLY_TOLERANCE);
+    CHECK(doneTime <= secondChunkDuration + CHUNK_LATE_TOLERANCE);
+    CHECK(g_simulatedMiP.volume() == MIP_VOLUME_4);
+}
+
+static void testShortSequenceSentOnce()
+{
+    const uint8_t length = sizeof(g_shortSequence) / sizeof(g_shortSequence[0]);
+    uint16_t      startCount = g_simulatedMiP.soundListCount();
+
+    g_mip.playSoundSequence(g_shortSequence);
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 1);
+    checkLastSoundList(g_shortSequence, 0, length);
+    uint32_t chunkTime = g_simulatedMiP.lastSoundListTime();
+
+    updateUntilSoundListCount(startCount + 2);
+    CHECK(!g_mip.isSoundSequencePlaying());
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 1);
+    uint32_t doneTime = micros() - chunkTime;
+    uint32_t duration = expectedDuration(g_shortSequence, 0, length);
+    CHECK(doneTime >= duration - CHUNK_EARLY_TOLERANCE);
+    CHECK(doneTime <= duration + CHUNK_LATE_TOLERANCE);
+}
+
+static void testStoppedSequenceSendsNoMoreChunks()
+{
+    uint16_t startCount = g_simulatedMiP.soundListCount();
+
+    g_mip.playSoundSequence(g_longSequence);
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 1);
+    g_mip.stopSoundSequence();
+    CHECK(!g_mip.isSoundSequencePlaying());
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 2);
+    CHECK(g_simulatedMiP.lastSoundList()[0] == MIP_SOUND_SHORT_MUTE_FOR_STOP);
+
+    // Give update() more than enough time to have sent the next group if the sequence was still playing.
+    uint32_t startTime = micros();
+    while (micros() - startTime < expectedDuration(g_longSequence, 0, 8) + CHUNK_LATE_TOLERANCE)
+    {
+        g_mip.update();
+        delayMicroseconds(500);
+    }
+    CHECK(g_simulatedMiP.soundListCount() == startCount + 2);
+}
+
+int main()
+{
+    // Periodic status notifications aren't needed by these tests.
+    g_simulatedMiP.setStatusInterval(0);
+    if (!CHECK(g_mip.begin()))
+    {
+        return testResult("test_sound_sequence");
+    }
+
+    testLongSequenceSentInTimedChunks();
+    testShortSequenceSentOnce();
+    testStoppedSequenceSendsNoMoreChunks();
+
+    return testResult("test_sound_sequence");
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Stress tests SpscQueue with a producer and a consumer running on separate threads, like an interrupt handler and
+   loop() on the AVR. Every element must come out once, in order and without being torn by the other thread.
+*/
+#include <thread>
+#include <queue.h>
+#include "mip_test.h"
+
+
+// Number of elements sent from the producer to the consumer.
+#define ELEMENT_COUNT   5000000
+
+
+// Element which is larger than a single word so that a torn copy would show up as a mismatch between its fields.
+struct StressElement
+{
+    uint32_t sequence;
+    uint32_t check;
+    uint8_t  padding[5];
+};
+
+static SpscQueue<StressElement, 16> g_queue;
+
+
+static uint32_t checkValue(uint32_t sequence)
+{
+    return ~sequence * 2654435761U;
+}
+
+static void producer(uint32_t* pFullCount)
+{
+    uint32_t fullCount = 0;
+
+    for (uint32_t sequence = 0 ; sequence < ELEMENT_COUNT ; )
+    {
+        StressElement element;
+        element.sequence = sequence;
+        element.check = checkValue(sequence);
+        memset(element.padding, (uint8_t)sequence, sizeof(element.padding));
+        if (g_queue.push(element))
+        {
+            sequence++;
+        }
+        else
+        {
+            fullCount++;
+            std::this_thread::yield();
+        }
+    }
+    *pFullCount = fullCount;
+}
+
+static void testSingleThreaded()
+{
+    SpscQueue<uint8_t, 4> queue;
+    uint8_t               element;
+
+    CHECK(queue.isEmpty());
+    CHECK(!queue.pop(element));
+    for (uint8_t i = 0 ; i < 4 ; i++)
+    {
+        CHECK(queue.push(i));
+    }
+    CHECK(queue.isFull());
+    CHECK(!queue.push(4));
+    CHECK(queue.peek(element) && element == 0);
+    CHECK(queue.available() == 4);
+    for (uint8_t i = 0 ; i < 4 ; i++)
+    {
+        CHECK(queue.pop(element) && element == i);
+    }
+    CHECK(queue.isEmpty());
+}
+
+static void testTwoThreads()
+{
+    uint32_t    fullCount = 0;
+    uint32_t    expectedSequence = 0;
+    uint32_t    errorCount = 0;
+    std::thread producerThread(producer, &fullCount);
+
+    while (expectedSequence < ELEMENT_COUNT)
+    {
+        StressElement element;
+        if (!g_queue.pop(element))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (element.sequence != expectedSequence || element.check != checkValue(expectedSequence) ||
+            element.padding[0] != (uint8_t)expectedSequence ||
+            element.padding[sizeof(element.padding) - 1] != (uint8_t)expectedSequence)
+        {
+            errorCount++;
+        }
+        expectedSequence++;
+    }
+    producerThread.join();
+
+    printf("Sent %u elements between threads, producer found the queue full %u times.\n",
+           expectedSequence, fullCount);
+    CHECK(errorCount == 0);
+    CHECK(g_queue.isEmpty());
+}
+
+int main()
+{
+    testSingleThreaded();
+    testTwoThreads();
+
+    return testResult("test_spsc_queue");
+}
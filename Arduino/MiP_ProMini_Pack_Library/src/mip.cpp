@@ -14,11 +14,26 @@
 */
 /* Implementation of MiP C API. */
 #include "mip.h"
+#include "mip_protocol.h"
+#include "mip_log.h"
+#if MIP_USE_SIMULATOR
+#include "mip_simulator.h"
+#endif
+#if MIP_PERSIST_CONNECTION
+#include <EEPROM.h>
+#endif
 
 
 // Make sure that the MiP module itself always uses the actual Serial object and not the redirection to MiPStream.
 #undef Serial
 
+// The UART is driven by IsrSerial instead of Serial when the interrupt driven receive path is enabled.
+#if MIP_USE_ISR_RECEIVE
+    #define MIP_SERIAL IsrSerial
+#else
+    #define MIP_SERIAL Serial
+#endif
+
 
 // Number of times that begin() method should try to initialize the MiP.
 #define MIP_MAX_BEGIN_RETRIES 5
@@ -26,19 +41,25 @@
 // Number of milliseconds to wait between retries in begin().
 #define MIP_BEGIN_RETRY_WAIT 500
 
-// Number of times to retry methods other than begin().
-#define MIP_MAX_RETRIES 2
+// Value stored in the signature field of MiPConnectionRecord to indicate that the EEPROM holds a connection record.
+#define MIP_CONNECTION_SIGNATURE 0x4D
 
-// Number of milliseconds to wait between retries in methods other than begin().
-#define MIP_RETRY_WAIT 50
+// The link is considered healthy, and the first retry is sent right away, if m_linkHealth is at least this high.
+#define MIP_HEALTHY_LINK 192
 
 // Should timeout if expected response doesn't arrive back in this amount of time (in milliseconds).
 #define MIP_RESPONSE_TIMEOUT 100
 
-// Delay between requests sent to MiP (in milliseconds). If the user attempts to send requests to the MiP faster than
-// this, the library will busy wait and only continue with the request after this amount of time has passed. The MiP
-// will sometimes ignore requests sent faster than this.
-#define MIP_REQUEST_DELAY 8
+// Delay between requests sent to MiP (in microseconds), measured from when the last byte of the previous request
+// finished transmitting. If the user attempts to send requests to the MiP faster than this, the library will either
+// queue the request to be sent later from update() (async requests) or busy wait and only continue with the request
+// after this amount of time has passed. The MiP will sometimes ignore requests sent too quickly.
+// MIP_MIN_REQUEST_DELAY is the fixed 8 millisecond gap that earlier versions of this library used, which is known to be
+// safe for every request, including the ones like drive and sound commands whose delivery can't be verified. How
+// quickly the MiP answers get requests says nothing about how closely those can be spaced so the tuning only ever
+// raises the delay above this floor, up to MIP_MAX_REQUEST_DELAY, for MiPs which are slow to respond.
+#define MIP_MIN_REQUEST_DELAY 8000
+#define MIP_MAX_REQUEST_DELAY 16000
 
 // Delay between continuousDrive requests sent to MiP (in milliseconds). continuousDrive() will just ignore faster
 // requests.
@@ -50,61 +71,6 @@
 // Last addressable address in EEPROM.
 #define MIP_LAST_EEPROM_ADDRESS 0x2F
 
-// Baud rate to use for MiP/PC communications.
-#define MIP_BAUD_RATE 115200
-
-// Slower baud rate used by newer MiP robots.
-#define MIP_SLOWER_BAUD_RATE 9600
-
-// MiP Protocol Commands.
-// These command codes are placed in the first byte of requests sent to the MiP and responses sent back from the MiP.
-// See https://github.com/WowWeeLabs/MiP-BLE-Protocol/blob/master/MiP-Protocol.md for more information.
-#define MIP_CMD_RECEIVE_IR_DONGLE_CODE  0x03
-#define MIP_CMD_GET_DETECTED_MIP        0x04
-#define MIP_CMD_PLAY_SOUND              0x06
-#define MIP_CMD_SET_POSITION            0x08
-#define MIP_CMD_GET_GESTURE_RESPONSE    0x0A
-#define MIP_CMD_SET_GESTURE_RADAR_MODE  0x0C
-#define MIP_CMD_GET_RADAR_RESPONSE      0x0C
-#define MIP_CMD_GET_GESTURE_RADAR_MODE  0x0D
-#define MIP_CMD_SET_DETECTION_MODE      0x0E
-#define MIP_CMD_SET_IR_REMOTE_CONTROL   0x10
-#define MIP_CMD_GET_IR_REMOTE_CONTROL   0x11
-#define MIP_CMD_SET_USER_DATA           0x12
-#define MIP_CMD_GET_USER_DATA           0x13
-#define MIP_CMD_GET_SOFTWARE_VERSION    0x14
-#define MIP_CMD_SET_VOLUME              0x15
-#define MIP_CMD_GET_VOLUME              0x16
-#define MIP_CMD_GET_HARDWARE_INFO       0x19
-#define MIP_CMD_SHAKE_RESPONSE          0x1A
-#define MIP_CMD_CLAP_RESPONSE           0x1D
-#define MIP_CMD_ENABLE_CLAP             0x1E
-#define MIP_CMD_GET_CLAP_SETTINGS       0x1F
-#define MIP_CMD_SET_CLAP_DELAY          0x20
-#define MIP_CMD_GET_UP                  0x23
-#define MIP_CMD_DISTANCE_DRIVE          0x70
-#define MIP_CMD_DRIVE_FORWARD           0x71
-#define MIP_CMD_DRIVE_BACKWARD          0x72
-#define MIP_CMD_TURN_LEFT               0x73
-#define MIP_CMD_TURN_RIGHT              0x74
-#define MIP_CMD_SET_GAME_MODE           0x76
-#define MIP_CMD_STOP                    0x77
-#define MIP_CMD_CONTINUOUS_DRIVE        0x78
-#define MIP_CMD_GET_STATUS              0x79
-#define MIP_CMD_GET_WEIGHT              0x81
-#define MIP_CMD_GET_GAME_MODE           0x82
-#define MIP_CMD_GET_CHEST_LED           0x83
-#define MIP_CMD_SET_CHEST_LED           0x84
-#define MIP_CMD_READ_ODOMETER           0x85
-#define MIP_CMD_RESET_ODOMETER          0x86
-#define MIP_CMD_FLASH_CHEST_LED         0x89
-#define MIP_CMD_SET_HEAD_LEDS           0x8A
-#define MIP_CMD_GET_HEAD_LEDS           0x8B
-#define MIP_CMD_SEND_IR_DONGLE_CODE     0x8C
-#define MIP_CMD_SLEEP                   0xFA
-#define MIP_CMD_DISCONNECT_APP          0xFE
-
-
 // expectResponse parameter values for transportSendRequest() parameter.
 #define MIP_EXPECT_NO_RESPONSE 0
 #define MIP_EXPECT_RESPONSE    1
@@ -116,6 +82,313 @@
 #define MIP_IR_REMOTE_CONTROL_ENABLE  1
 
 
+// Lookup table used by mipParseHexDigit() to convert hex text sent from the MiP into 4-bit values. The first entry is
+// for '0' and the last is for 'f'. Characters in between which aren't valid hex digits map to MIP_INVALID_HEX_DIGIT.
+#define XX MIP_INVALID_HEX_DIGIT
+static const uint8_t g_hexDigitValues[] PROGMEM =
+{
+//   0   1   2   3   4   5   6   7   8   9   :   ;   <   =   >   ?
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+//   @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   O
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+//   P   Q   R   S   T   U   V   W   X   Y   Z   [   \   ]   ^   _
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+//   `   a   b   c   d   e   f
+    XX, 10, 11, 12, 13, 14, 15
+};
+#undef XX
+
+// Converts a 4-bit value back into the hex digit that the MiP would have sent for it.
+static const uint8_t g_hexDigitChars[] PROGMEM =
+{
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+// Descriptors for every possible command byte value, packed at compile time from the g_mipCommandInfo list in
+// mip_protocol.h. Indexed directly by command byte.
+#define MIP_DESCRIPTOR_ROW(BASE) \
+    mipCommandDescriptor(BASE + 0x0), mipCommandDescriptor(BASE + 0x1), mipCommandDescriptor(BASE + 0x2), \
+    mipCommandDescriptor(BASE + 0x3), mipCommandDescriptor(BASE + 0x4), mipCommandDescriptor(BASE + 0x5), \
+    mipCommandDescriptor(BASE + 0x6), mipCommandDescriptor(BASE + 0x7), mipCommandDescriptor(BASE + 0x8), \
+    mipCommandDescriptor(BASE + 0x9), mipCommandDescriptor(BASE + 0xA), mipCommandDescriptor(BASE + 0xB), \
+    mipCommandDescriptor(BASE + 0xC), mipCommandDescriptor(BASE + 0xD), mipCommandDescriptor(BASE + 0xE), \
+    mipCommandDescriptor(BASE + 0xF)
+static const uint16_t g_commandDescriptors[256] PROGMEM =
+{
+    MIP_DESCRIPTOR_ROW(0x00), MIP_DESCRIPTOR_ROW(0x10), MIP_DESCRIPTOR_ROW(0x20), MIP_DESCRIPTOR_ROW(0x30),
+    MIP_DESCRIPTOR_ROW(0x40), MIP_DESCRIPTOR_ROW(0x50), MIP_DESCRIPTOR_ROW(0x60), MIP_DESCRIPTOR_ROW(0x70),
+    MIP_DESCRIPTOR_ROW(0x80), MIP_DESCRIPTOR_ROW(0x90), MIP_DESCRIPTOR_ROW(0xA0), MIP_DESCRIPTOR_ROW(0xB0),
+    MIP_DESCRIPTOR_ROW(0xC0), MIP_DESCRIPTOR_ROW(0xD0), MIP_DESCRIPTOR_ROW(0xE0), MIP_DESCRIPTOR_ROW(0xF0)
+};
+#undef MIP_DESCRIPTOR_ROW
+
+uint16_t mipLookupCommandDescriptor(uint8_t commandByte)
+{
+    return pgm_read_word(&g_commandDescriptors[commandByte]);
+}
+
+uint8_t mipParseHexDigit(uint8_t digit)
+{
+    uint8_t index = digit - '0';
+    if (index >= sizeof(g_hexDigitValues))
+    {
+        return MIP_INVALID_HEX_DIGIT;
+    }
+    return pgm_read_byte(&g_hexDigitValues[index]);
+}
+
+#if MIP_ENABLE_STATS
+// Each command which the library sends to the MiP is counted in its own slot of MiPStats. The slots are assigned at
+// compile time from the g_mipCommandInfo list, with the commands that have responses numbered first.
+#define MIP_STATS_NO_SLOT 0xFF
+
+static constexpr bool mipIsRequest(const MiPCommandInfo& info)
+{
+    return info.requestLength > 0 || (info.flags & MIP_CMD_FLAG_RESPONSE) || !(info.flags & MIP_CMD_FLAG_OOB);
+}
+
+static constexpr bool mipHasResponse(const MiPCommandInfo& info)
+{
+    return (info.flags & MIP_CMD_FLAG_RESPONSE) != 0;
+}
+
+// Counts the requests, either with or without responses, which come before index end in g_mipCommandInfo.
+static constexpr uint8_t mipCountStatsSlots(uint8_t end, bool withResponse, uint8_t index = 0)
+{
+    return index >= end ? 0 :
+           (mipIsRequest(g_mipCommandInfo[index]) && mipHasResponse(g_mipCommandInfo[index]) == withResponse) +
+           mipCountStatsSlots(end, withResponse, index + 1);
+}
+
+static constexpr uint8_t mipStatsSlotForEntry(uint8_t index)
+{
+    return !mipIsRequest(g_mipCommandInfo[index]) ? MIP_STATS_NO_SLOT :
+           mipHasResponse(g_mipCommandInfo[index]) ? mipCountStatsSlots(index, true) :
+           mipCountStatsSlots(MIP_COMMAND_INFO_COUNT, true) + mipCountStatsSlots(index, false);
+}
+
+static constexpr uint8_t mipStatsSlot(uint8_t command, uint8_t index = 0)
+{
+    return index >= MIP_COMMAND_INFO_COUNT ? MIP_STATS_NO_SLOT :
+           g_mipCommandInfo[index].command == command ? mipStatsSlotForEntry(index) :
+           mipStatsSlot(command, index + 1);
+}
+
+static_assert(mipCountStatsSlots(MIP_COMMAND_INFO_COUNT, true) == MIP_STATS_RESPONSE_SLOTS,
+              "MIP_STATS_RESPONSE_SLOTS doesn't match g_mipCommandInfo.");
+static_assert(mipCountStatsSlots(MIP_COMMAND_INFO_COUNT, true) + mipCountStatsSlots(MIP_COMMAND_INFO_COUNT, false) ==
+              MIP_STATS_REQUEST_SLOTS, "MIP_STATS_REQUEST_SLOTS doesn't match g_mipCommandInfo.");
+
+// Stats slot for every possible command byte value. Indexed directly by command byte.
+#define MIP_STATS_SLOT_ROW(BASE) \
+    mipStatsSlot(BASE + 0x0), mipStatsSlot(BASE + 0x1), mipStatsSlot(BASE + 0x2), mipStatsSlot(BASE + 0x3), \
+    mipStatsSlot(BASE + 0x4), mipStatsSlot(BASE + 0x5), mipStatsSlot(BASE + 0x6), mipStatsSlot(BASE + 0x7), \
+    mipStatsSlot(BASE + 0x8), mipStatsSlot(BASE + 0x9), mipStatsSlot(BASE + 0xA), mipStatsSlot(BASE + 0xB), \
+    mipStatsSlot(BASE + 0xC), mipStatsSlot(BASE + 0xD), mipStatsSlot(BASE + 0xE), mipStatsSlot(BASE + 0xF)
+static const uint8_t g_statsSlots[256] PROGMEM =
+{
+    MIP_STATS_SLOT_ROW(0x00), MIP_STATS_SLOT_ROW(0x10), MIP_STATS_SLOT_ROW(0x20), MIP_STATS_SLOT_ROW(0x30),
+    MIP_STATS_SLOT_ROW(0x40), MIP_STATS_SLOT_ROW(0x50), MIP_STATS_SLOT_ROW(0x60), MIP_STATS_SLOT_ROW(0x70),
+    MIP_STATS_SLOT_ROW(0x80), MIP_STATS_SLOT_ROW(0x90), MIP_STATS_SLOT_ROW(0xA0), MIP_STATS_SLOT_ROW(0xB0),
+    MIP_STATS_SLOT_ROW(0xC0), MIP_STATS_SLOT_ROW(0xD0), MIP_STATS_SLOT_ROW(0xE0), MIP_STATS_SLOT_ROW(0xF0)
+};
+#undef MIP_STATS_SLOT_ROW
+
+uint16_t MiPStats::sentCount(uint8_t command) const
+{
+    uint8_t slot = pgm_read_byte(&g_statsSlots[command]);
+    if (slot == MIP_STATS_NO_SLOT)
+    {
+        return 0;
+    }
+    return sent[slot];
+}
+
+const MiPCommandStats* MiPStats::responseStats(uint8_t command) const
+{
+    uint8_t slot = pgm_read_byte(&g_statsSlots[command]);
+    if (slot >= MIP_STATS_RESPONSE_SLOTS)
+    {
+        return NULL;
+    }
+    return &responses[slot];
+}
+
+uint8_t MiPStats::slotCommand(uint8_t slot)
+{
+    // Only used when reporting the stats so just search the table for the slot.
+    uint8_t command = 0;
+    do
+    {
+        if (pgm_read_byte(&g_statsSlots[command]) == slot)
+        {
+            return command;
+        }
+    } while (++command != 0);
+    return 0;
+}
+#endif // MIP_ENABLE_STATS
+
+// Placeholder guesses at how long each sound takes to play, used by the sound queue and sound sequences to decide when
+// the next sound should be sent to the MiP. Only MIP_SOUND_ONEKHZ_500MS_8K16BIT has a known length. The rest haven't
+// been measured on a robot and were guessed from their names, which is why every MIP_SOUND_MOOD_* entry has the same
+// value, so any of them can be off by a second or more. Replace them with measured lengths as they become available.
+// Stored in the MiP's 30 millisecond delay units, rounded to the nearest unit, and indexed by MiPSoundIndex - 1.
+#define MIP_SOUND_DURATION(MILLIS) (((MILLIS) + 15) / 30)
+static const uint8_t g_soundDurations[] PROGMEM =
+{
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_ONEKHZ_500MS_8K16BIT
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_ACTION_BURPING
+    MIP_SOUND_DURATION(1800), // MIP_SOUND_ACTION_DRINKING
+    MIP_SOUND_DURATION(1800), // MIP_SOUND_ACTION_EATING
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_ACTION_FARTING_SHORT
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_ACTION_OUT_OF_BREATH
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_BOXING_PUNCHCONNECT_1
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_BOXING_PUNCHCONNECT_2
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_BOXING_PUNCHCONNECT_3
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_FREESTYLE_TRACKING_1
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_1
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_2
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_3
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_APP
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_AWWW
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_BIG_SHOT
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_BLEH
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_BOOM
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_BYE
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_MIP_CONVERSE_1
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_MIP_CONVERSE_2
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_DROP
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_DUNNO
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_FALL_OVER_1
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_FALL_OVER_2
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_FIGHT
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_GAME
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_GLOAT
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_GO
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_GOGOGO
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_GRUNT_1
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_GRUNT_2
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_GRUNT_3
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_HAHA_GOT_IT
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_HI_CONFIDENT
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_HI_NOT_SURE
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_HI_SCARED
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_HUH
+    MIP_SOUND_DURATION(3000), // MIP_SOUND_MIP_HUMMING_1
+    MIP_SOUND_DURATION(3000), // MIP_SOUND_MIP_HUMMING_2
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_HURT
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_HUUURGH
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_IN_LOVE
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_MIP_IT
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_MIP_JOKE
+    MIP_SOUND_DURATION(500),  // MIP_SOUND_MIP_K
+    MIP_SOUND_DURATION(3000), // MIP_SOUND_MIP_LOOP_1
+    MIP_SOUND_DURATION(3000), // MIP_SOUND_MIP_LOOP_2
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_LOW_BATTERY
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_MIPPEE
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_MORE
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_MUAH_HA
+    MIP_SOUND_DURATION(4000), // MIP_SOUND_MIP_MUSIC
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_OBSTACLE
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_OHOH
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_OH_YEAH
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_OOPSIE
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_OUCH_1
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_OUCH_2
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_PLAY
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_PUSH
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_RUN
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_SHAKE
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_SIGH
+    MIP_SOUND_DURATION(4000), // MIP_SOUND_MIP_SINGING
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_SNEEZE
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_MIP_SNORE
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_STACK
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_SWIPE_1
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_SWIPE_2
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_TRICKS
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_TRIIICK
+    MIP_SOUND_DURATION(2000), // MIP_SOUND_MIP_TRUMPET
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MIP_WAAAAA
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_WAKEY
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_WHEEE
+    MIP_SOUND_DURATION(3000), // MIP_SOUND_MIP_WHISTLING
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_WHOAH
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_WOO
+    MIP_SOUND_DURATION(800),  // MIP_SOUND_MIP_YEAH
+    MIP_SOUND_DURATION(1200), // MIP_SOUND_MIP_YEEESSS
+    MIP_SOUND_DURATION(600),  // MIP_SOUND_MIP_YO
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_MIP_YUMMY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_ACTIVATED
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_ANGRY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_ANXIOUS
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_BORING
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_CRANKY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_ENERGETIC
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_EXCITED
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_GIDDY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_GRUMPY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_HAPPY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_IDEA
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_IMPATIENT
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_NICE
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_SAD
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_SHORT
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_SLEEPY
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_MOOD_TIRED
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_SOUND_BOOST
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_SOUND_CAGE
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_SOUND_GUNS
+    MIP_SOUND_DURATION(1000), // MIP_SOUND_SOUND_ZINGS
+    MIP_SOUND_DURATION(90),   // MIP_SOUND_SHORT_MUTE_FOR_STOP
+    MIP_SOUND_DURATION(1500), // MIP_SOUND_FREESTYLE_TRACKING_2
+};
+#undef MIP_SOUND_DURATION
+static_assert(sizeof(g_soundDurations) == MIP_SOUND_FREESTYLE_TRACKING_2,
+              "g_soundDurations needs an entry for each MiPSoundIndex.");
+static_assert(MIP_SOUND_QUEUE_SIZE >= 1, "MIP_SOUND_QUEUE_SIZE must be at least 1.");
+
+// Returns the estimated number of milliseconds that it takes the MiP to play a sound. Volume changes take no time.
+static uint16_t soundDuration(uint8_t sound)
+{
+    if (sound < 1 || sound > sizeof(g_soundDurations))
+    {
+        return 0;
+    }
+    return pgm_read_byte(&g_soundDurations[sound - 1]) * 30;
+}
+
+// Returns the estimated number of milliseconds that it takes the MiP to play a sound list entry, including its delay.
+static uint32_t soundEntryDuration(uint8_t sound, uint8_t delay)
+{
+    return (uint32_t)delay * 30 + soundDuration(sound);
+}
+
+#if MIP_PERSIST_CONNECTION
+// Record stored in EEPROM by MiP::begin() to remember the last MiP that it connected to.
+struct MiPConnectionRecord
+{
+    uint32_t baudRate;
+    uint8_t  signature;
+    uint8_t  checksum;
+};
+
+static uint8_t calculateConnectionChecksum(const MiPConnectionRecord& record)
+{
+    const uint8_t* pBytes = (const uint8_t*)&record;
+    uint8_t        checksum = 0;
+
+    for (size_t i = 0 ; i < offsetof(MiPConnectionRecord, checksum) ; i++)
+    {
+        // Rotate before adding in each byte so that swapped bytes still change the checksum.
+        checksum = ((checksum << 1) | (checksum >> 7)) + pBytes[i];
+    }
+    return ~checksum;
+}
+#endif // MIP_PERSIST_CONNECTION
+
+
 // It is expected that the user will only instantiate a single MiP object (mostly likely a global object). This
 // pointer is set from within that singleton's constructor and later used by the global MiPStream when it needs to
 // call upon the MiP object to switch the UART between MiP and PC.
@@ -123,24 +396,137 @@ MiP* MiP::s_pInstance = NULL;
 
 
 
+// Sends a diagnostic event to the PC, either as text or as a binary record depending on MIP_LOG_MODE. The meaning of
+// arg0 and arg1 for each event is given by the MIP_LOG_EVENTS table in mip_log.h. 32-bit arguments are split with the
+// lower 16 bits in arg0.
+static void mipLog(MiPLogEvent event, uint16_t arg0 = 0, uint16_t arg1 = 0)
+{
+#if MIP_LOG_MODE == MIP_LOG_BINARY
+    uint16_t timestamp = (uint16_t)millis();
+    uint8_t  record[MIP_LOG_RECORD_SIZE];
+    uint8_t  sum = 0;
+
+    record[0] = MIP_LOG_MARKER;
+    record[1] = event;
+    record[2] = timestamp;
+    record[3] = timestamp >> 8;
+    record[4] = arg0;
+    record[5] = arg0 >> 8;
+    record[6] = arg1;
+    record[7] = arg1 >> 8;
+    for (uint8_t i = 1 ; i < MIP_LOG_RECORD_SIZE - 1 ; i++)
+    {
+        sum += record[i];
+    }
+    record[MIP_LOG_RECORD_SIZE - 1] = MIP_LOG_CHECKSUM(sum);
+    MiPStream.write(record, sizeof(record));
+#else
+    switch (event)
+    {
+    case MIP_LOG_ASSERT:
+        MiPStream.print(F("MiP Assert: mip.cpp:"));
+        MiPStream.println(arg0);
+        break;
+    case MIP_LOG_CONNECTED:
+        MiPStream.print(F("MiP: Connected at "));
+        MiPStream.print((uint32_t)arg1 << 16 | arg0);
+        MiPStream.println(F(" baud."));
+        break;
+    case MIP_LOG_API_RESULT:
+        MiPStream.print(F("MiP: API returned "));
+        switch ((int16_t)arg0)
+        {
+        case MIP_ERROR_TIMEOUT:
+            MiPStream.println(F("MIP_ERROR_TIMEOUT (Timed out waiting for response)"));
+            break;
+        case MIP_ERROR_NO_EVENT:
+            MiPStream.println(F("MIP_ERROR_NO_EVENT (No event has arrived from MiP yet)"));
+            break;
+        case MIP_ERROR_BAD_RESPONSE:
+            MiPStream.println(F("MIP_ERROR_BAD_RESPONSE (Unexpected response from MiP)"));
+            break;
+        case MIP_ERROR_MAX_RETRIES:
+            MiPStream.println(F("MIP_ERROR_MAX_RETRIES (Exceeded maximum number of retries to get this operation to succeed)"));
+            break;
+        default:
+            MiPStream.println(F("unknown error"));
+            break;
+        }
+        break;
+    case MIP_LOG_RESPONSE_TIMEOUT:
+        MiPStream.println(F("MiP: Response timeout"));
+        break;
+    case MIP_LOG_RESPONSE_TOO_SHORT:
+        MiPStream.print(F("MiP: Response too short: "));
+        MiPStream.print(arg0);
+        MiPStream.print(',');
+        MiPStream.println(arg1);
+        break;
+    case MIP_LOG_OOB_TOO_SHORT:
+        MiPStream.print(F("MiP: OOB too short: "));
+        MiPStream.print(arg0);
+        MiPStream.print(',');
+        MiPStream.println(arg1);
+        break;
+    case MIP_LOG_RESYNC_SKIPPED:
+        MiPStream.print(F("MiP: Skipped "));
+        MiPStream.print(arg0);
+        MiPStream.println(F(" bytes to resync"));
+        break;
+    }
+#endif // MIP_LOG_MODE == MIP_LOG_BINARY
+}
+
 // Define an assert mechanism that can be used to log and halt when the user is found to be calling the API incorrectly.
 #define MIP_ASSERT(EXPRESSION) if (!(EXPRESSION)) mipAssert(__LINE__);
 
-static void mipAssert(uint32_t lineNumber)
+static void mipAssert(uint16_t lineNumber)
 {
-    MiPStream.print(F("MiP Assert: mip.cpp:"));
-        MiPStream.println(lineNumber);
+    mipLog(MIP_LOG_ASSERT, lineNumber);
+    MiPStream.flush();
 
     while (1)
     {
     }
 }
 
+#if !MIP_USE_SIMULATOR
+// Constructed on first use so that only sketches which use the default MiP constructor pay for the serial transport.
+// Only one MiP object is supported so the select pin given to the first call is the one that sticks.
+static MiPTransport& mipDefaultSerialTransport(int8_t serialSelectPin)
+{
+#if MIP_USE_ISR_RECEIVE
+    static MiPIsrTransport    transport(MIP_SERIAL, serialSelectPin);
+#else
+    static MiPSerialTransport transport(MIP_SERIAL, serialSelectPin);
+#endif
+    return transport;
+}
+#endif // !MIP_USE_SIMULATOR
 
 
 MiP::MiP(int8_t serialSelectPin /* = MIP_UART_SELECT_PIN */)
 {
-    m_serialSelectPin = serialSelectPin;
+#if MIP_USE_SIMULATOR
+    (void)serialSelectPin;
+    m_pTransport = &mipDefaultSimulator();
+#else
+    m_pTransport = &mipDefaultSerialTransport(serialSelectPin);
+#endif
+    m_mipSlotMillis = 0;
+    m_pcSlotMillis = 0;
+
+    clear();
+
+    // Track this instance in class specific global so that MiPStream can find it.
+    s_pInstance = this;
+}
+
+MiP::MiP(MiPTransport& transport)
+{
+    m_pTransport = &transport;
+    m_mipSlotMillis = 0;
+    m_pcSlotMillis = 0;
 
     clear();
 
@@ -156,15 +542,27 @@ MiP::~MiP()
 
 void MiP::clear()
 {
-    m_lastRequestTime = millis();
+    m_lastRequestTime = micros();
     m_lastContinuousDriveTime = millis();
     m_mipBaudRate = MIP_BAUD_RATE;
+    m_requestDelay = MIP_MIN_REQUEST_DELAY;
+    m_responseLatency = MIP_MIN_REQUEST_DELAY / 2;
     m_flags = 0;
     memset(m_responseBuffer, 0, sizeof(m_responseBuffer));
     m_expectedResponseCommand = 0;
     m_expectedResponseSize = 0;
     m_lastError = MIP_ERROR_NONE;
     m_soundIndex = -1;
+    m_pSoundSequence = NULL;
+    m_soundSequenceLength = 0;
+    m_soundSequenceIndex = 0;
+    m_soundSequenceChunkEndTime = 0;
+    m_soundQueueLength = 0;
+    m_currentSound = 0;
+    m_currentSoundPriority = 0;
+    m_currentSoundEndTime = 0;
+    m_isSoundListPlaying = false;
+    m_soundListEndTime = 0;
     m_lastRadar = MIP_RADAR_INVALID;
     m_lastStatus.clear();
     m_lastWeight = 0;
@@ -172,32 +570,62 @@ void MiP::clear()
     m_gestureEvents.clear();
     m_detectedMiPEvents.clear();
     m_irCodeEvents.clear();
+    m_requestQueue.clear();
     m_irId = 0x00;
+    m_pActiveRetryPolicy = &m_retryPolicy;
+    m_retryStartTime = 0;
+    m_retryAttempt = 0;
+    m_linkHealth = 255;
+    m_retryCount = 0;
+    m_mipSlotStartTime = millis();
+#if MIP_ENABLE_STATS
+    m_stats.clear();
+    m_statsLastResponseCommand = 0;
+#endif
+#if MIP_TRACE_SIZE > 0
+    clearTrace();
+#endif
+    m_cachedSettings = 0;
+    m_readCacheTTL = 0;
+    m_rxLastDigitTime = millis();
+    m_rxFrameArrivalTime = (uint16_t)m_rxLastDigitTime;
+    m_rxReplayIndex = 0;
+    m_rxReplayLength = 0;
+    m_rxResyncSkippedBytes = 0;
+    m_rxSkippedBytes = 0;
+    resetResponseDecoder();
 }
 
 bool MiP::begin()
 {
-    // Configure the pin used to select the UART destination between the MiP and PC.
-    pinMode(m_serialSelectPin, OUTPUT);
-    digitalWrite(m_serialSelectPin, LOW);
+    // Claim the hardware used to talk to the MiP. On the MiP ProMini Pack this configures the pin used to select the
+    // UART destination between the MiP and PC.
+    m_pTransport->begin();
 
     // The MiP requires the UART to communicate at 115200-N-8-1.
     // Call MiPStream.begin() instead of Serial.begin() directly so that it can track the begin/end state. This allows
     // it to know that it should automatically initialize the Serial stream to 115200 if the user attempts to write to
     // it before calling this MiP::begin method.
     MiPStream.begin(MIP_BAUD_RATE);
-    Serial.setTimeout(MIP_RESPONSE_TIMEOUT);
 
     // Initialize the class members.
     clear();
     // Roll the timers back so that the first calls can occur immediately.
-    m_lastRequestTime = millis() - MIP_REQUEST_DELAY;
+    m_lastRequestTime = micros() - MIP_MAX_REQUEST_DELAY;
     m_lastContinuousDriveTime = millis() - MIP_CONTINUOUS_DRIVE_DELAY;
 
     // Assume that the connection to the MiP will be successfully initialized. Will clear the flag if a connection
     // error is detected. If this wasn't done then the calls to rawSend() & rawGetStatus() below would fail.
     m_flags |= MRI_FLAG_INITIALIZED;
 
+    // Try the baud rate which worked last time first since it is most likely to be the same MiP again. Don't wait after
+    // this attempt fails since the loop below goes straight on to try both baud rates.
+    uint32_t lastBaudRate = readLastConnectionBaudRate();
+    if (lastBaudRate != 0 && attemptMiPConnection(lastBaudRate) == MIP_ERROR_NONE)
+    {
+        return true;
+    }
+
     // Sometimes the init fails. It seems to happen when the MiP is busy at power-up doing other things like
     // attempting to balance.
     int8_t retry;
@@ -210,16 +638,21 @@ bool MiP::begin()
         if (result == MIP_ERROR_NONE)
         {
             // Connection succeeded at 115200.
+            rememberConnection();
             return true;
         }
+        // Sleep a bit before retrying the connection at the alternate baud rate.
+        delay(MIP_BEGIN_RETRY_WAIT);
 
         // Try to connect at 9600 baud, the rate used by newer MiP robots.
         result = attemptMiPConnection(MIP_SLOWER_BAUD_RATE);
         if (result == MIP_ERROR_NONE)
         {
             // Connection succeeded at 9600.
+            rememberConnection();
             return true;
         }
+        delay(MIP_BEGIN_RETRY_WAIT);
     }
 
     // Get here if connection to the MiP never succeeds.
@@ -232,7 +665,7 @@ int8_t MiP::attemptMiPConnection(uint32_t baudRate)
 {
     // Set baud rate to specified rate.
     m_mipBaudRate = baudRate;
-    Serial.begin(baudRate);
+    m_pTransport->setBaudRate(baudRate);
 
     // Send 0xFF to the MiP via UART to enable the UART communication channel in the MiP.
     const uint8_t initMipCommand[] = { 0xFF };
@@ -248,16 +681,45 @@ int8_t MiP::attemptMiPConnection(uint32_t baudRate)
     if (result == MIP_ERROR_NONE)
     {
         // Let the user know which baud rate the connection to the MiP was made.
-        MiPStream.print(F("MiP: Connected at "));
-            MiPStream.print(baudRate);
-            MiPStream.println(F(" baud."));
+        mipLog(MIP_LOG_CONNECTED, baudRate, baudRate >> 16);
     }
-    else
+    return result;
+}
+
+// This internal protected method returns the baud rate of the last MiP that begin() connected to or 0 if it isn't
+// known.
+uint32_t MiP::readLastConnectionBaudRate()
+{
+#if MIP_PERSIST_CONNECTION
+    MiPConnectionRecord record;
+
+    static_assert(sizeof(record) <= MIP_CONNECTION_EEPROM_SIZE, "MIP_CONNECTION_EEPROM_SIZE is too small.");
+    EEPROM.get(MIP_CONNECTION_EEPROM_ADDRESS, record);
+    if (record.signature != MIP_CONNECTION_SIGNATURE ||
+        record.checksum != calculateConnectionChecksum(record) ||
+        (record.baudRate != MIP_BAUD_RATE && record.baudRate != MIP_SLOWER_BAUD_RATE))
     {
-        // Sleep a bit before returning to code which will retry connection at alternate baud rate.
-        delay(MIP_BEGIN_RETRY_WAIT);
+        return 0;
     }
-    return result;
+    return record.baudRate;
+#else
+    return 0;
+#endif // MIP_PERSIST_CONNECTION
+}
+
+// This internal protected method saves the baud rate of the MiP that begin() just connected to in EEPROM.
+void MiP::rememberConnection()
+{
+#if MIP_PERSIST_CONNECTION
+    MiPConnectionRecord record;
+
+    record.baudRate = m_mipBaudRate;
+    record.signature = MIP_CONNECTION_SIGNATURE;
+    record.checksum = calculateConnectionChecksum(record);
+
+    // EEPROM.put() only writes the bytes which have changed so reconnecting to the same MiP causes no EEPROM wear.
+    EEPROM.put(MIP_CONNECTION_EEPROM_ADDRESS, record);
+#endif // MIP_PERSIST_CONNECTION
 }
 
 void MiP::end()
@@ -268,12 +730,13 @@ void MiP::end()
         // blue chest LED.
         const uint8_t command[] = { MIP_CMD_DISCONNECT_APP };
         rawSend(command, sizeof(command));
+        transportFlushRequestQueue();
     }
 
     clear();
 
     MiPStream.end();
-    pinMode(m_serialSelectPin, INPUT);
+    m_pTransport->end();
 }
 
 void MiP::sleep()
@@ -282,6 +745,8 @@ void MiP::sleep()
     // The MiP will need to be reset before another begin() will succeed.
     const uint8_t command[] = { MIP_CMD_SLEEP };
     rawSend(command, sizeof(command));
+    transportFlushRequestQueue();
+    invalidateCachedSettings();
 }
 
 
@@ -290,165 +755,730 @@ void MiP::printLastCallResult()
 {
     if (m_lastError != MIP_ERROR_NONE)
     {
-        MiPStream.print(F("MiP: API returned "));
-        switch (m_lastError)
-        {
-        case MIP_ERROR_TIMEOUT:
-            MiPStream.println(F("MIP_ERROR_TIMEOUT (Timed out waiting for response)"));
-            break;
-        case MIP_ERROR_NO_EVENT:
-            MiPStream.println(F("MIP_ERROR_NO_EVENT (No event has arrived from MiP yet)"));
-            break;
-        case MIP_ERROR_BAD_RESPONSE:
-            MiPStream.println(F("MIP_ERROR_BAD_RESPONSE (Unexpected response from MiP)"));
-            break;
-        case MIP_ERROR_MAX_RETRIES:
-            MiPStream.println(F("MIP_ERROR_MAX_RETRIES (Exceeded maximum number of retries to get this operation to succeed)"));
-            break;
-        default:
-            MiPStream.println(F("unknown error"));
-            break;
-        }
+        mipLog(MIP_LOG_API_RESULT, (int16_t)m_lastError);
     }
 }
 
+void MiP::setRetryPolicy(const MiPRetryPolicy& policy)
+{
+    MIP_ASSERT ( policy.maxAttempts >= 1 && policy.backoffFactor >= 1 );
+    m_retryPolicy = policy;
+}
 
-void MiP::enableRadarMode()
+void MiP::getRetryPolicy(MiPRetryPolicy& policy)
 {
-    verifiedSetGestureRadarMode(MIP_RADAR);
+    policy = m_retryPolicy;
 }
 
-void MiP::enableGestureMode()
+void MiP::overrideRetryPolicyForNextCall(const MiPRetryPolicy& policy)
 {
-    verifiedSetGestureRadarMode(MIP_GESTURE);
+    MIP_ASSERT ( policy.maxAttempts >= 1 && policy.backoffFactor >= 1 );
+    m_retryPolicyOverride = policy;
+    m_flags |= MIP_FLAG_RETRY_OVERRIDE;
 }
 
-void MiP::disableRadarMode()
+void MiP::pinRequestDelay(uint16_t microseconds)
 {
-    verifiedSetGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+    m_requestDelay = microseconds;
+    m_flags |= MIP_FLAG_REQUEST_DELAY_PINNED;
 }
 
-void MiP::disableGestureMode()
+void MiP::unpinRequestDelay()
 {
-    verifiedSetGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+    m_flags &= ~MIP_FLAG_REQUEST_DELAY_PINNED;
 }
 
-// This internal protected method sends the command to change the radar/gesture mode and then sends a request to get
-// the new state. If this request fails or the new state isn't as expected, it will retry the command.
-void MiP::verifiedSetGestureRadarMode(MiPGestureRadarMode desiredMode)
+// This internal protected method is called before the first attempt of each retry loop to select the retry policy to
+// be used for the attempts which follow.
+void MiP::beginRetries()
 {
-    int8_t result;
+    if (m_flags & MIP_FLAG_RETRY_OVERRIDE)
+    {
+        m_pActiveRetryPolicy = &m_retryPolicyOverride;
+        m_flags &= ~MIP_FLAG_RETRY_OVERRIDE;
+    }
+    else
+    {
+        m_pActiveRetryPolicy = &m_retryPolicy;
+    }
+    m_retryAttempt = 0;
+    m_retryStartTime = millis();
+}
 
-    // Always mark cached RADAR data as invalid when changing modes.
-    m_flags &= ~MIP_FLAG_RADAR_VALID;
+// This internal protected method is called with the result of each attempt made by a retry loop. It returns true,
+// after waiting as long as the retry policy dictates, if another attempt should be made.
+bool MiP::shouldRetry(int8_t result)
+{
+    const MiPRetryPolicy& policy = *m_pActiveRetryPolicy;
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    updateLinkHealth(result == MIP_ERROR_NONE);
+    if (result == MIP_ERROR_NONE)
     {
-        rawSetGestureRadarMode(desiredMode);
+        return false;
+    }
+    statsRecordFailure(result);
 
-        // Read back and make sure that it was set as expected.
-        MiPGestureRadarMode actualMode = MIP_GESTURE_RADAR_DISABLED;
-        result = rawGetGestureRadarMode(actualMode);
-        if (result == MIP_ERROR_NONE && actualMode == desiredMode)
+    m_retryAttempt++;
+    uint16_t retryDelay = calculateRetryDelay();
+    if (m_retryAttempt >= policy.maxAttempts ||
+        (policy.deadline != 0 && millis() - m_retryStartTime + retryDelay >= policy.deadline))
+    {
+        // Out of attempts or another attempt would end after the deadline so give up now.
+        if (result == MIP_ERROR_TIMEOUT)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // The MiP stopped answering, maybe because it was reset, so the settings remembered for it can't be trusted.
+            invalidateCachedSettings();
         }
+        return false;
+    }
+
+    delay(retryDelay);
+    m_retryCount++;
+    statsRecordRetry();
+    return true;
+}
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+// This internal protected method returns the number of milliseconds to wait before the next retry.
+uint16_t MiP::calculateRetryDelay()
+{
+    const MiPRetryPolicy& policy = *m_pActiveRetryPolicy;
+
+    // An occasional corrupted response on an otherwise healthy link is best fixed by retrying right away.
+    if (policy.adaptive && m_retryAttempt == 1 && m_linkHealth >= MIP_HEALTHY_LINK)
+    {
+        return 0;
     }
 
-    if (result != MIP_ERROR_NONE)
+    uint32_t retryDelay = policy.retryDelay;
+    for (uint8_t i = 1 ; i < m_retryAttempt && retryDelay < policy.maxRetryDelay ; i++)
     {
-        // Kept getting an error back from rawGetGestureRadarMode().
-        m_lastError = result;
+        retryDelay *= policy.backoffFactor;
     }
-    else
+    if (policy.adaptive)
+    {
+        // Wait up to 3 times longer as the link becomes less healthy.
+        retryDelay += retryDelay * (255 - m_linkHealth) / 128;
+    }
+    if (retryDelay > policy.maxRetryDelay)
     {
-        // rawGetGestureRadarMode() was successful but didn't match mode to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        retryDelay = policy.maxRetryDelay;
     }
+    return retryDelay;
 }
 
-bool MiP::isRadarModeEnabled()
+// This internal protected method keeps an exponentially weighted moving average of how many attempts are succeeding.
+void MiP::updateLinkHealth(bool succeeded)
 {
-    return checkGestureRadarMode(MIP_RADAR);
+    if (succeeded)
+    {
+        m_linkHealth += (255 - m_linkHealth + 7) / 8;
+    }
+    else
+    {
+        m_linkHealth -= (m_linkHealth + 7) / 8;
+    }
 }
 
-bool MiP::isGestureModeEnabled()
+
+#if MIP_ENABLE_STATS
+void MiP::snapshotStats(MiPStats& stats)
 {
-    return checkGestureRadarMode(MIP_GESTURE);
+    stats = m_stats;
 }
 
-bool MiP::areGestureAndRadarModesDisabled()
+void MiP::resetStats()
 {
-    return checkGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+    m_stats.clear();
 }
+#endif // MIP_ENABLE_STATS
 
-// This internal protected method requests the current radar/gesture mode and then returns whether it matches the
-// passed in value or not. It includes retry code incase the request should fail.
-bool MiP::checkGestureRadarMode(MiPGestureRadarMode expectedMode)
+// This internal protected method counts a request as it is written to the MiP.
+void MiP::statsRecordRequest(uint8_t command)
 {
-    int8_t result;
-
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+#if MIP_ENABLE_STATS
+    uint8_t slot = pgm_read_byte(&g_statsSlots[command]);
+    if (slot != MIP_STATS_NO_SLOT)
     {
-        MiPGestureRadarMode currentMode;
-        result = rawGetGestureRadarMode(currentMode);
-        if (result == MIP_ERROR_NONE)
-        {
-            return currentMode == expectedMode;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+        m_stats.sent[slot]++;
     }
-
-    m_lastError = result;
-    return false;
+#else
+    (void)command;
+#endif // MIP_ENABLE_STATS
 }
 
-MiPRadar MiP::readRadar()
+// This internal protected method counts a response and adds how long it took to arrive to the latency histogram.
+void MiP::statsRecordResponse(uint8_t command, uint32_t latency)
 {
-    // Fetch bytes from the Serial receive buffer and process any event data found within.
-    processAllResponseData();
-
-    if ((m_flags & MIP_FLAG_RADAR_VALID) == 0)
+#if MIP_ENABLE_STATS
+    m_statsLastResponseCommand = command;
+    uint8_t slot = pgm_read_byte(&g_statsSlots[command]);
+    if (slot >= MIP_STATS_RESPONSE_SLOTS)
     {
-        // Haven't received a radar event yet.
-        m_lastError = MIP_ERROR_NO_EVENT;
-        return MIP_RADAR_INVALID;
+        return;
     }
 
-    m_lastError = MIP_ERROR_NONE;
-    return m_lastRadar;
+    MiPCommandStats& commandStats = m_stats.responses[slot];
+    uint32_t         scaledLatency = latency >> MIP_STATS_LATENCY_SHIFT;
+    uint8_t          bucket = 0;
+    while (scaledLatency != 0 && bucket < MIP_STATS_LATENCY_BUCKETS - 1)
+    {
+        scaledLatency >>= 1;
+        bucket++;
+    }
+    commandStats.latency[bucket]++;
+    commandStats.responses++;
+    if (latency > commandStats.maxLatency)
+    {
+        commandStats.maxLatency = latency;
+    }
+#else
+    (void)command;
+    (void)latency;
+#endif // MIP_ENABLE_STATS
 }
 
-uint8_t MiP::availableGestureEvents()
+void MiP::statsRecordTimeout(uint8_t command)
 {
-    // Fetch bytes from the Serial receive buffer and process any event data found within.
-    processAllResponseData();
-    m_lastError = MIP_ERROR_NONE;
-    return m_gestureEvents.available();
+#if MIP_ENABLE_STATS
+    m_statsLastResponseCommand = command;
+    uint8_t slot = pgm_read_byte(&g_statsSlots[command]);
+    if (slot < MIP_STATS_RESPONSE_SLOTS)
+    {
+        m_stats.responses[slot].timeouts++;
+    }
+#else
+    (void)command;
+#endif // MIP_ENABLE_STATS
 }
 
-MiPGesture MiP::readGestureEvent()
+// This internal protected method is called by shouldRetry() when an attempt fails. Responses which arrived but didn't
+// make sense are charged to the last command that a response was received for.
+void MiP::statsRecordFailure(int8_t result)
 {
-    // Fetch bytes from the Serial receive buffer and process any event data found within.
-    processAllResponseData();
-
-    MiPGesture gestureEvent = MIP_GESTURE_INVALID;
-    if (!m_gestureEvents.pop(gestureEvent))
+#if MIP_ENABLE_STATS
+    uint8_t slot = pgm_read_byte(&g_statsSlots[m_statsLastResponseCommand]);
+    if (result == MIP_ERROR_BAD_RESPONSE && slot < MIP_STATS_RESPONSE_SLOTS)
     {
-        m_lastError = MIP_ERROR_NO_EVENT;
-        return MIP_GESTURE_INVALID;
+        m_stats.responses[slot].badResponses++;
     }
-    m_lastError = MIP_ERROR_NONE;
-    return gestureEvent;
+#else
+    (void)result;
+#endif // MIP_ENABLE_STATS
+}
+
+// This internal protected method is called by shouldRetry() when a retry is made. Verified writes which fail because
+// the MiP ignored the write are charged to the command used to read back the setting.
+void MiP::statsRecordRetry()
+{
+#if MIP_ENABLE_STATS
+    uint8_t slot = pgm_read_byte(&g_statsSlots[m_statsLastResponseCommand]);
+    if (slot < MIP_STATS_RESPONSE_SLOTS)
+    {
+        m_stats.responses[slot].retries++;
+    }
+#endif // MIP_ENABLE_STATS
+}
+
+// This internal protected method counts an out of band notification which has been received and validated.
+void MiP::statsRecordOob(uint8_t command)
+{
+#if MIP_ENABLE_STATS
+    MiPOobType type;
+    switch (command)
+    {
+    case MIP_CMD_GET_STATUS:
+        type = MIP_OOB_STATUS;
+        break;
+    case MIP_CMD_GET_WEIGHT:
+        type = MIP_OOB_WEIGHT;
+        break;
+    case MIP_CMD_GET_RADAR_RESPONSE:
+        type = MIP_OOB_RADAR;
+        break;
+    case MIP_CMD_GET_GESTURE_RESPONSE:
+        type = MIP_OOB_GESTURE;
+        break;
+    case MIP_CMD_CLAP_RESPONSE:
+        type = MIP_OOB_CLAP;
+        break;
+    case MIP_CMD_SHAKE_RESPONSE:
+        type = MIP_OOB_SHAKE;
+        break;
+    case MIP_CMD_GET_DETECTED_MIP:
+        type = MIP_OOB_DETECTED_MIP;
+        break;
+    case MIP_CMD_RECEIVE_IR_DONGLE_CODE:
+        type = MIP_OOB_IR_CODE;
+        break;
+    default:
+        return;
+    }
+    m_stats.oobFrames[type]++;
+#else
+    (void)command;
+#endif // MIP_ENABLE_STATS
+}
+
+
+#if MIP_TRACE_SIZE > 0
+static_assert(MIP_TRACE_SIZE >= MIP_TRACE_RECORD_HEADER_SIZE + MIP_REQUEST_MAX_LEN && MIP_TRACE_SIZE <= 0xFFFF,
+              "MIP_TRACE_SIZE must be large enough to hold the longest request and fit in 16 bits.");
+static_assert(MIP_REQUEST_MAX_LEN <= MIP_TRACE_LENGTH_MASK, "Longest request doesn't fit in a trace record.");
+
+void MiP::dumpTrace()
+{
+    uint32_t currentTime = micros();
+    uint8_t  header[13];
+
+    // Start with a header which marks the start of the dump and gives the current time so that the timestamps of the
+    // records which follow can be related to the time of the dump.
+    header[0] = 'M';
+    header[1] = 'i';
+    header[2] = 'P';
+    header[3] = 'T';
+    header[4] = MIP_TRACE_FORMAT_VERSION;
+    memcpy(&header[5], &currentTime, sizeof(currentTime));
+    header[9] = m_traceOverwritten;
+    header[10] = m_traceOverwritten >> 8;
+    header[11] = m_traceLength;
+    header[12] = m_traceLength >> 8;
+    MiPStream.write(header, sizeof(header));
+
+    // Send the records as they sit in the ring buffer, oldest first.
+    uint16_t firstPart = MIP_TRACE_SIZE - m_traceStart;
+    if (firstPart > m_traceLength)
+    {
+        firstPart = m_traceLength;
+    }
+    MiPStream.write(&m_trace[m_traceStart], firstPart);
+    MiPStream.write(m_trace, m_traceLength - firstPart);
+}
+
+void MiP::clearTrace()
+{
+    m_traceStart = 0;
+    m_traceLength = 0;
+    m_traceOverwritten = 0;
+}
+#endif // MIP_TRACE_SIZE > 0
+
+// This internal protected method adds a request or frame to the trace, overwriting the oldest records if it is full.
+void MiP::traceRecord(uint8_t flags, const uint8_t* pData, uint8_t length)
+{
+#if MIP_TRACE_SIZE > 0
+    uint8_t  header[MIP_TRACE_RECORD_HEADER_SIZE];
+    uint32_t timestamp = micros();
+    uint16_t recordSize = sizeof(header) + length;
+
+    while (MIP_TRACE_SIZE - m_traceLength < recordSize)
+    {
+        uint8_t  oldestSize = sizeof(header) + (m_trace[m_traceStart] & MIP_TRACE_LENGTH_MASK);
+        uint16_t start = m_traceStart + oldestSize;
+        m_traceStart = start >= MIP_TRACE_SIZE ? start - MIP_TRACE_SIZE : start;
+        m_traceLength -= oldestSize;
+        m_traceOverwritten++;
+    }
+
+    header[0] = flags | length;
+    memcpy(&header[1], &timestamp, sizeof(timestamp));
+    traceAppend(header, sizeof(header));
+    traceAppend(pData, length);
+#else
+    // Silence compiler warnings about unused parameters.
+    (void)flags;
+    (void)pData;
+    (void)length;
+#endif // MIP_TRACE_SIZE > 0
+}
+
+#if MIP_TRACE_SIZE > 0
+// This internal protected method copies bytes to the end of the trace ring buffer, wrapping around as needed. The
+// caller must have already made room for them.
+void MiP::traceAppend(const uint8_t* pData, uint8_t length)
+{
+    uint16_t end = m_traceStart + m_traceLength;
+    if (end >= MIP_TRACE_SIZE)
+    {
+        end -= MIP_TRACE_SIZE;
+    }
+    uint16_t firstPart = MIP_TRACE_SIZE - end;
+    if (firstPart > length)
+    {
+        firstPart = length;
+    }
+    memcpy(&m_trace[end], pData, firstPart);
+    memcpy(m_trace, pData + firstPart, length - firstPart);
+    m_traceLength += length;
+}
+#endif // MIP_TRACE_SIZE > 0
+
+
+void MiP::update()
+{
+    if (!isInitialized())
+    {
+        return;
+    }
+
+    // Send any queued requests that the MiP is now ready to accept and then process any notifications that it has sent.
+    transportSendQueuedRequests();
+    processAllResponseData();
+    updateSoundSequence();
+    updateSoundQueue();
+
+    // Now is a good time to send any buffered Serial output to the PC, unless the MiP is part way through sending a
+    // frame which would be lost while the UART is switched away.
+    if (isResponseFrameInProgress())
+    {
+        return;
+    }
+    if (m_mipSlotMillis == 0)
+    {
+        MiPStream.sendBufferedOutput();
+        return;
+    }
+
+    // When serial slots are set, the UART stays with the MiP until its slot has expired and then the PC only gets it
+    // for long enough to send pcSlotMillis worth of output. Anything left over waits for the next PC slot.
+    uint32_t currentTime = millis();
+    if (currentTime - m_mipSlotStartTime < m_mipSlotMillis)
+    {
+        return;
+    }
+    m_mipSlotStartTime = currentTime;
+
+    uint8_t maxLength = 0xFF;
+    if (m_pcSlotMillis != 0)
+    {
+        // Each byte takes 10 bit times at the 115200 baud used for the PC, so about 11 bytes fit in each millisecond.
+        uint32_t slotLength = (uint32_t)m_pcSlotMillis * (MIP_BAUD_RATE / 10 / 1000);
+        if (slotLength < maxLength)
+        {
+            maxLength = slotLength;
+        }
+    }
+    MiPStream.sendBufferedOutput(maxLength);
+}
+
+void MiP::enableAsyncRequests()
+{
+    m_flags |= MIP_FLAG_ASYNC_REQUESTS;
+}
+
+void MiP::disableAsyncRequests()
+{
+    // Don't leave any requests in the queue since update() might not be called anymore.
+    transportFlushRequestQueue();
+    m_flags &= ~MIP_FLAG_ASYNC_REQUESTS;
+}
+
+bool MiP::areAsyncRequestsEnabled()
+{
+    return (m_flags & MIP_FLAG_ASYNC_REQUESTS) != 0;
+}
+
+void MiP::setSerialSlots(uint16_t mipSlotMillis, uint16_t pcSlotMillis)
+{
+    m_mipSlotMillis = mipSlotMillis;
+    m_pcSlotMillis = pcSlotMillis;
+    m_mipSlotStartTime = millis();
+    MiPStream.sendEachLine(mipSlotMillis == 0);
+}
+
+uint16_t MiP::getMiPSlot()
+{
+    return m_mipSlotMillis;
+}
+
+uint16_t MiP::getPCSlot()
+{
+    return m_pcSlotMillis;
+}
+
+
+void MiP::onGesture(MiPGestureCallback callback)
+{
+    m_callbacks.gesture = callback;
+}
+
+void MiP::onRadar(MiPRadarCallback callback)
+{
+    m_callbacks.radar = callback;
+}
+
+void MiP::onClap(MiPClapCallback callback)
+{
+    m_callbacks.clap = callback;
+}
+
+void MiP::onShake(MiPShakeCallback callback)
+{
+    m_callbacks.shake = callback;
+}
+
+void MiP::onStatusChange(MiPStatusCallback callback)
+{
+    m_callbacks.statusChange = callback;
+}
+
+void MiP::onIRCode(MiPIRCodeCallback callback)
+{
+    m_callbacks.irCode = callback;
+}
+
+void MiP::onMiPDetected(MiPDetectedCallback callback)
+{
+    m_callbacks.detectedMiP = callback;
+}
+
+void MiP::setEventOverflowPolicy(MiPEventOverflowPolicy policy)
+{
+    m_clapEvents.setOverflowPolicy((QueueOverflowPolicy)policy);
+    m_gestureEvents.setOverflowPolicy((QueueOverflowPolicy)policy);
+    m_irCodeEvents.setOverflowPolicy((QueueOverflowPolicy)policy);
+    m_detectedMiPEvents.setOverflowPolicy((QueueOverflowPolicy)policy);
+}
+
+void MiP::invalidateCachedSettings()
+{
+    m_cachedSettings = 0;
+}
+
+void MiP::enableReadCache(uint16_t timeToLive)
+{
+    m_readCacheTTL = timeToLive;
+}
+
+void MiP::disableReadCache()
+{
+    m_readCacheTTL = 0;
+}
+
+bool MiP::isReadCacheEnabled()
+{
+    return m_readCacheTTL != 0;
+}
+
+// This internal protected method records that the m_cached* field for this setting now matches the MiP.
+void MiP::cacheSetting(uint8_t setting)
+{
+    m_cachedSettings |= (1 << setting);
+    m_cachedTimes[setting] = millis();
+}
+
+void MiP::uncacheSetting(uint8_t setting)
+{
+    m_cachedSettings &= ~(1 << setting);
+}
+
+bool MiP::isSettingCached(uint8_t setting)
+{
+    return (m_cachedSettings & (1 << setting)) != 0;
+}
+
+// This internal protected method returns true if the read cache is enabled and the setting was confirmed with the MiP
+// recently enough that it can be returned to the caller without sending a new request.
+bool MiP::isCachedSettingFresh(uint8_t setting)
+{
+    return m_readCacheTTL != 0 && isSettingCached(setting) && millis() - m_cachedTimes[setting] < m_readCacheTTL;
+}
+
+// These internal protected methods remember a setting which was just confirmed with the MiP so that later writes of
+// the same setting can be skipped.
+void MiP::cacheChestLED(const MiPChestLED& chestLED)
+{
+    m_cachedChestLED = chestLED;
+    cacheSetting(MIP_CACHED_CHEST_LED);
+}
+
+void MiP::cacheHeadLEDs(const MiPHeadLEDs& headLEDs)
+{
+    m_cachedHeadLEDs = headLEDs;
+    cacheSetting(MIP_CACHED_HEAD_LEDS);
+}
+
+void MiP::cacheVolume(uint8_t volume)
+{
+    m_cachedVolume = volume;
+    cacheSetting(MIP_CACHED_VOLUME);
+}
+
+void MiP::cacheGameMode(MiPGameMode mode)
+{
+    // The other game modes can finish on their own so only the app mode can be trusted to stick.
+    if (mode != MIP_APP_MODE)
+    {
+        uncacheSetting(MIP_CACHED_GAME_MODE);
+        return;
+    }
+    m_cachedGameMode = mode;
+    cacheSetting(MIP_CACHED_GAME_MODE);
+}
+
+void MiP::cacheGestureRadarMode(MiPGestureRadarMode mode)
+{
+    m_cachedGestureRadarMode = mode;
+    cacheSetting(MIP_CACHED_GESTURE_RADAR_MODE);
+}
+
+void MiP::cacheClapSettings(const MiPClapSettings& settings)
+{
+    m_cachedClapSettings = settings;
+    cacheSetting(MIP_CACHED_CLAP_SETTINGS);
+}
+
+
+void MiP::enableRadarMode()
+{
+    verifiedSetGestureRadarMode(MIP_RADAR);
+}
+
+void MiP::enableGestureMode()
+{
+    verifiedSetGestureRadarMode(MIP_GESTURE);
+}
+
+void MiP::disableRadarMode()
+{
+    verifiedSetGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+}
+
+void MiP::disableGestureMode()
+{
+    verifiedSetGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+}
+
+// This internal protected method sends the command to change the radar/gesture mode and then sends a request to get
+// the new state. If this request fails or the new state isn't as expected, it will retry the command.
+void MiP::verifiedSetGestureRadarMode(MiPGestureRadarMode desiredMode)
+{
+    int8_t result;
+
+    if (isSettingCached(MIP_CACHED_GESTURE_RADAR_MODE) && m_cachedGestureRadarMode == desiredMode)
+    {
+        // Already in the desired mode so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_GESTURE_RADAR_MODE);
+
+    // Always mark cached RADAR data as invalid when changing modes.
+    m_flags &= ~MIP_FLAG_RADAR_VALID;
+
+    MiPGestureRadarMode actualMode = MIP_GESTURE_RADAR_DISABLED;
+    beginRetries();
+    do
+    {
+        rawSetGestureRadarMode(desiredMode);
+
+        // Read back and make sure that it was set as expected.
+        result = rawGetGestureRadarMode(actualMode);
+        if (result == MIP_ERROR_NONE && actualMode != desiredMode)
+        {
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
+        }
+    } while (shouldRetry(result));
+
+    if (result == MIP_ERROR_NONE)
+    {
+        cacheGestureRadarMode(actualMode);
+    }
+    m_lastError = result;
+}
+
+bool MiP::isRadarModeEnabled()
+{
+    return checkGestureRadarMode(MIP_RADAR);
+}
+
+bool MiP::isGestureModeEnabled()
+{
+    return checkGestureRadarMode(MIP_GESTURE);
+}
+
+bool MiP::areGestureAndRadarModesDisabled()
+{
+    return checkGestureRadarMode(MIP_GESTURE_RADAR_DISABLED);
+}
+
+// This internal protected method requests the current radar/gesture mode and then returns whether it matches the
+// passed in value or not. It includes retry code incase the request should fail.
+bool MiP::checkGestureRadarMode(MiPGestureRadarMode expectedMode)
+{
+    int8_t result;
+
+    if (isCachedSettingFresh(MIP_CACHED_GESTURE_RADAR_MODE))
+    {
+        return m_cachedGestureRadarMode == expectedMode;
+    }
+
+    MiPGestureRadarMode currentMode;
+    beginRetries();
+    do
+    {
+        result = rawGetGestureRadarMode(currentMode);
+    } while (shouldRetry(result));
+
+    if (result != MIP_ERROR_NONE)
+    {
+        m_lastError = result;
+        return false;
+    }
+    cacheGestureRadarMode(currentMode);
+    return currentMode == expectedMode;
+}
+
+MiPRadar MiP::readRadar()
+{
+    // Fetch bytes from the Serial receive buffer and process any event data found within.
+    processAllResponseData();
+
+    if ((m_flags & MIP_FLAG_RADAR_VALID) == 0)
+    {
+        // Haven't received a radar event yet.
+        m_lastError = MIP_ERROR_NO_EVENT;
+        return MIP_RADAR_INVALID;
+    }
+
+    m_lastError = MIP_ERROR_NONE;
+    return m_lastRadar;
+}
+
+uint8_t MiP::availableGestureEvents()
+{
+    // Fetch bytes from the Serial receive buffer and process any event data found within.
+    processAllResponseData();
+    m_lastError = MIP_ERROR_NONE;
+    return m_gestureEvents.available();
+}
+
+MiPGesture MiP::readGestureEvent()
+{
+    uint16_t arrivalTime;
+    return readGestureEvent(arrivalTime);
+}
+
+MiPGesture MiP::readGestureEvent(uint16_t& arrivalTime)
+{
+    // Fetch bytes from the Serial receive buffer and process any event data found within.
+    processAllResponseData();
+
+    TimedEvent<MiPGesture> gestureEvent;
+    if (!m_gestureEvents.pop(gestureEvent))
+    {
+        m_lastError = MIP_ERROR_NO_EVENT;
+        return MIP_GESTURE_INVALID;
+    }
+    m_lastError = MIP_ERROR_NONE;
+    arrivalTime = gestureEvent.arrivalTime;
+    return gestureEvent.value;
+}
+
+uint16_t MiP::droppedGestureEvents()
+{
+    m_lastError = MIP_ERROR_NONE;
+    return m_gestureEvents.droppedCount();
 }
 
 // This internal protected method sends the set gesture/radar mode command with no error checking. The error handling /
@@ -467,7 +1497,7 @@ void MiP::rawSetGestureRadarMode(MiPGestureRadarMode mode)
 int8_t MiP::rawGetGestureRadarMode(MiPGestureRadarMode& mode)
 {
     const uint8_t getGestureRadarMode[1] = { MIP_CMD_GET_GESTURE_RADAR_MODE };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_GESTURE_RADAR_MODE)];
     size_t        responseLength;
     int8_t        result;
 
@@ -476,7 +1506,7 @@ int8_t MiP::rawGetGestureRadarMode(MiPGestureRadarMode& mode)
     {
         return result;
     }
-    if (responseLength != 2 ||
+    if (responseLength != sizeof(response) ||
         response[0] != MIP_CMD_GET_GESTURE_RADAR_MODE ||
         (response[1] != MIP_GESTURE_RADAR_DISABLED &&
          response[1] != MIP_GESTURE &&
@@ -498,40 +1528,43 @@ void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue)
     // The blue channel is actually only 6-bit and not a full 8-bit so zero out lower 2 bits (the MiP does this too).
     blue &= ~3;
 
+    if (isSettingCached(MIP_CACHED_CHEST_LED) &&
+        m_cachedChestLED.red == red &&
+        m_cachedChestLED.green == green &&
+        m_cachedChestLED.blue == blue &&
+        m_cachedChestLED.onTime == 0 &&
+        m_cachedChestLED.offTime == 0)
+    {
+        // The chest LED is already set to this colour so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_CHEST_LED);
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    MiPChestLED actualChestLED;
+    beginRetries();
+    do
     {
         rawSetChestLED(red, green, blue);
 
         // Read back and make sure that it was set as expected.
-        MiPChestLED actualChestLED;
         result = rawGetChestLED(actualChestLED);
-        if (result == MIP_ERROR_NONE &&
-            actualChestLED.red == red &&
-            actualChestLED.green == green &&
-            actualChestLED.blue == blue)
+        if (result == MIP_ERROR_NONE && (actualChestLED.red != red ||
+                                         actualChestLED.green != green ||
+                                         actualChestLED.blue != blue))
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read attempt.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read was successful but didn't match setting to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheChestLED(actualChestLED);
     }
+    m_lastError = result;
 }
 
 void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime)
@@ -546,42 +1579,45 @@ void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTim
     // The blue channel is actually only 6-bit and not a full 8-bit so zero out lower 2 bits (the MiP does this too).
     blue &= ~3;
 
+    if (isSettingCached(MIP_CACHED_CHEST_LED) &&
+        m_cachedChestLED.red == red &&
+        m_cachedChestLED.green == green &&
+        m_cachedChestLED.blue == blue &&
+        m_cachedChestLED.onTime / 20 == onTime &&
+        m_cachedChestLED.offTime / 20 == offTime)
+    {
+        // The chest LED is already flashing this way so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_CHEST_LED);
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    MiPChestLED actualChestLED;
+    beginRetries();
+    do
     {
         rawFlashChestLED(red, green, blue, onTime, offTime);
 
         // Read back and make sure that it was set as expected.
-        MiPChestLED actualChestLED;
         result = rawGetChestLED(actualChestLED);
-        if (result == MIP_ERROR_NONE &&
-            actualChestLED.red == red &&
-            actualChestLED.green == green &&
-            actualChestLED.blue == blue &&
-            actualChestLED.onTime / 20 == onTime &&
-            actualChestLED.offTime / 20 == offTime)
+        if (result == MIP_ERROR_NONE && (actualChestLED.red != red ||
+                                         actualChestLED.green != green ||
+                                         actualChestLED.blue != blue ||
+                                         actualChestLED.onTime / 20 != onTime ||
+                                         actualChestLED.offTime / 20 != offTime))
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read attempt.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read was successful but didn't match setting to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheChestLED(actualChestLED);
     }
+    m_lastError = result;
 }
 
 void MiP::writeChestLED(const MiPChestLED& chestLED)
@@ -589,30 +1625,53 @@ void MiP::writeChestLED(const MiPChestLED& chestLED)
     writeChestLED(chestLED.red, chestLED.green, chestLED.blue, chestLED.onTime, chestLED.offTime);
 }
 
+void MiP::forceWriteChestLED(uint8_t red, uint8_t green, uint8_t blue)
+{
+    // Forgetting the remembered setting means that writeChestLED() can't skip the write.
+    uncacheSetting(MIP_CACHED_CHEST_LED);
+    writeChestLED(red, green, blue);
+}
+
+void MiP::forceWriteChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime)
+{
+    uncacheSetting(MIP_CACHED_CHEST_LED);
+    writeChestLED(red, green, blue, onTime, offTime);
+}
+
+void MiP::forceWriteChestLED(const MiPChestLED& chestLED)
+{
+    forceWriteChestLED(chestLED.red, chestLED.green, chestLED.blue, chestLED.onTime, chestLED.offTime);
+}
+
 void MiP::readChestLED(MiPChestLED& chestLED)
 {
     int8_t result;
 
+    if (isCachedSettingFresh(MIP_CACHED_CHEST_LED))
+    {
+        chestLED = m_cachedChestLED;
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    beginRetries();
+    do
     {
         result = rawGetChestLED(chestLED);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return;
-        }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+    if (result == MIP_ERROR_NONE)
+    {
+        cacheChestLED(chestLED);
     }
-
     m_lastError = result;
 }
 
 void MiP::unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue)
 {
+    // Can't be sure that the MiP accepted this new setting so forget the cached one.
+    uncacheSetting(MIP_CACHED_CHEST_LED);
     rawSetChestLED(red, green, blue);
 }
 
@@ -623,6 +1682,8 @@ void MiP::unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue, uint
     onTime = (onTime + 10) / 20;
     offTime = (offTime + 10) / 20;
 
+    // Can't be sure that the MiP accepted this new setting so forget the cached one.
+    uncacheSetting(MIP_CACHED_CHEST_LED);
     rawFlashChestLED(red, green, blue, onTime, offTime);
 }
 
@@ -665,7 +1726,7 @@ void MiP::rawFlashChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t on
 int8_t MiP::rawGetChestLED(MiPChestLED& chestLED)
 {
     const uint8_t getChestLED[1] = { MIP_CMD_GET_CHEST_LED };
-    uint8_t       response[1+5];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_CHEST_LED)];
     size_t        responseLength;
     int           result;
 
@@ -694,41 +1755,43 @@ void MiP::writeHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHe
 {
     int8_t result;
 
+    if (isSettingCached(MIP_CACHED_HEAD_LEDS) &&
+        m_cachedHeadLEDs.led1 == led1 &&
+        m_cachedHeadLEDs.led2 == led2 &&
+        m_cachedHeadLEDs.led3 == led3 &&
+        m_cachedHeadLEDs.led4 == led4)
+    {
+        // The head LEDs are already set this way so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_HEAD_LEDS);
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    MiPHeadLEDs headLEDs;
+    beginRetries();
+    do
     {
         rawSetHeadLEDs(led1, led2, led3, led4);
 
         // Read back and make sure that it was set as expected.
-        MiPHeadLEDs headLEDs;
         result = rawGetHeadLEDs(headLEDs);
-        if (result == MIP_ERROR_NONE &&
-            headLEDs.led1 == led1 &&
-            headLEDs.led2 == led2 &&
-            headLEDs.led3 == led3 &&
-            headLEDs.led4 == led4)
+        if (result == MIP_ERROR_NONE && (headLEDs.led1 != led1 ||
+                                         headLEDs.led2 != led2 ||
+                                         headLEDs.led3 != led3 ||
+                                         headLEDs.led4 != led4))
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read attempt.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read was successful but didn't match setting to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheHeadLEDs(headLEDs);
     }
+    m_lastError = result;
 }
 
 void MiP::writeHeadLEDs(const MiPHeadLEDs& headLEDs)
@@ -736,30 +1799,47 @@ void MiP::writeHeadLEDs(const MiPHeadLEDs& headLEDs)
     writeHeadLEDs(headLEDs.led1, headLEDs.led2, headLEDs.led3, headLEDs.led4);
 }
 
+void MiP::forceWriteHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4)
+{
+    // Forgetting the remembered setting means that writeHeadLEDs() can't skip the write.
+    uncacheSetting(MIP_CACHED_HEAD_LEDS);
+    writeHeadLEDs(led1, led2, led3, led4);
+}
+
+void MiP::forceWriteHeadLEDs(const MiPHeadLEDs& headLEDs)
+{
+    forceWriteHeadLEDs(headLEDs.led1, headLEDs.led2, headLEDs.led3, headLEDs.led4);
+}
+
 void MiP::readHeadLEDs(MiPHeadLEDs& headLEDs)
 {
     int8_t result;
 
+    if (isCachedSettingFresh(MIP_CACHED_HEAD_LEDS))
+    {
+        headLEDs = m_cachedHeadLEDs;
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    beginRetries();
+    do
     {
         result = rawGetHeadLEDs(headLEDs);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return;
-        }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+    if (result == MIP_ERROR_NONE)
+    {
+        cacheHeadLEDs(headLEDs);
     }
-
     m_lastError = result;
 }
 
 void MiP::unverifiedWriteHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4)
 {
+    // Can't be sure that the MiP accepted this new setting so forget the cached one.
+    uncacheSetting(MIP_CACHED_HEAD_LEDS);
     rawSetHeadLEDs(led1, led2, led3, led4);
 }
 
@@ -788,7 +1868,7 @@ void MiP::rawSetHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPH
 int8_t MiP::rawGetHeadLEDs(MiPHeadLEDs& headLEDs)
 {
     const uint8_t getHeadLEDs[1] = { MIP_CMD_GET_HEAD_LEDS };
-    uint8_t       response[1+4];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_HEAD_LEDS)];
     size_t        responseLength;
     int           result;
 
@@ -1040,6 +2120,9 @@ void MiP::addEntryToSoundList(MiPSoundIndex sound, uint16_t delay /* = 0 */, MiP
         m_playCommand[1 + m_soundIndex * 2 + 1] = 0;
         m_playVolume = volume;
         m_soundIndex++;
+
+        // Playing this sound list will change the MiP's volume setting behind the back of writeVolume().
+        uncacheSetting(MIP_CACHED_VOLUME);
     }
 
     // The sound list can only hold 8 sound entries.
@@ -1056,6 +2139,9 @@ void MiP::playSoundList(uint8_t repeatCount /* = 0 */)
     // Must call beginSoundList() and addSoundToList() before calling this function.
     MIP_ASSERT ( m_soundIndex >= 1 );
 
+    // This sound list replaces any sequence that was still playing.
+    m_pSoundSequence = NULL;
+
     m_playCommand[0] = MIP_CMD_PLAY_SOUND;
 
     // Fill out the rest of the command buffer with mute sounds.
@@ -1074,68 +2160,362 @@ void MiP::playSoundList(uint8_t repeatCount /* = 0 */)
     // Set the index to 8 to flag that no more items can be added to the sound list but you can still play it again.
     m_soundIndex = 8;
 
+    // Record when the list should be done playing so that the sound queue can wait for it. The mute sounds used to fill
+    // out the list just stop it early so they don't count.
+    uint32_t duration = 0;
+    for (uint8_t i = 0 ; i < 8 ; i++)
+    {
+        uint8_t sound = m_playCommand[1 + i * 2];
+        if (sound != MIP_SOUND_SHORT_MUTE_FOR_STOP)
+        {
+            duration += soundEntryDuration(sound, m_playCommand[1 + i * 2 + 1]);
+        }
+    }
+    m_isSoundListPlaying = true;
+    m_soundListEndTime = millis() + duration * (repeatCount + 1);
+    interruptQueuedSound();
+
+    m_lastError = MIP_ERROR_NONE;
+}
+
+void MiP::playSoundSequence(const MiPSoundEntry* pSequence, uint8_t length)
+{
+    MIP_ASSERT ( pSequence != NULL && length >= 1 );
+
+    m_pSoundSequence = pSequence;
+    m_soundSequenceLength = length;
+    m_soundSequenceIndex = 0;
+    sendSoundSequenceChunk();
+    interruptQueuedSound();
+
+    m_lastError = MIP_ERROR_NONE;
+}
+
+bool MiP::isSoundSequencePlaying()
+{
+    return m_pSoundSequence != NULL;
+}
+
+void MiP::stopSoundSequence()
+{
+    if (!isSoundSequencePlaying())
+    {
+        return;
+    }
+    m_pSoundSequence = NULL;
+    // Cut off whatever part of the sequence the MiP is playing right now too.
+    sendSound(MIP_SOUND_SHORT_MUTE_FOR_STOP, MIP_VOLUME_DEFAULT);
+}
+
+// This internal protected method plays a single sound, optionally changing the volume first, with its own command
+// buffer so that the sound list built up with beginSoundList() and addEntryToSoundList() is left as it was.
+void MiP::sendSound(MiPSoundIndex sound, MiPVolume volume)
+{
+    uint8_t command[1+17];
+    uint8_t i = 0;
+
+    command[0] = MIP_CMD_PLAY_SOUND;
+    if (volume != MIP_VOLUME_DEFAULT)
+    {
+        command[1 + i * 2] = MIP_SOUND_VOLUME_OFF + volume;
+        command[1 + i * 2 + 1] = 0;
+        i++;
+
+        // Playing this sound will change the MiP's volume setting behind the back of writeVolume().
+        uncacheSetting(MIP_CACHED_VOLUME);
+    }
+    command[1 + i * 2] = sound;
+    command[1 + i * 2 + 1] = 0;
+    i++;
+    // Fill out the rest of the command buffer with mute sounds, just like playSoundList() does.
+    for ( ; i < 8 ; i++)
+    {
+        command[1 + i * 2] = MIP_SOUND_SHORT_MUTE_FOR_STOP;
+        command[1 + i * 2 + 1] = 0;
+    }
+    command[17] = 0;
+
+    // Send this command blindly with no error checking since there is no way to determine if it has failed.
+    rawSend(command, sizeof(command));
+}
+
+// This internal protected method sends the next 8 entries of the sound sequence being played, straight from program
+// memory, and records when they should be done playing.
+void MiP::sendSoundSequenceChunk()
+{
+    uint8_t  command[1+17];
+    uint32_t duration = 0;
+    uint8_t  i;
+
+    command[0] = MIP_CMD_PLAY_SOUND;
+    for (i = 0 ; i < 8 && m_soundSequenceIndex < m_soundSequenceLength ; i++, m_soundSequenceIndex++)
+    {
+        const MiPSoundEntry* pEntry = &m_pSoundSequence[m_soundSequenceIndex];
+        uint8_t              sound = pgm_read_byte(&pEntry->sound);
+        uint8_t              delay = pgm_read_byte(&pEntry->delay);
+
+        command[1 + i * 2] = sound;
+        command[1 + i * 2 + 1] = delay;
+        duration += soundEntryDuration(sound, delay);
+        if (sound >= MIP_SOUND_VOLUME_OFF)
+        {
+            // Playing this sequence will change the MiP's volume setting behind the back of writeVolume().
+            uncacheSetting(MIP_CACHED_VOLUME);
+        }
+    }
+    // Fill out the rest of the command buffer with mute sounds, just like playSoundList() does.
+    for ( ; i < 8 ; i++)
+    {
+        command[1 + i * 2] = MIP_SOUND_SHORT_MUTE_FOR_STOP;
+        command[1 + i * 2 + 1] = 0;
+    }
+    command[17] = 0;
+
+    // Send this command blindly with no error checking since there is no way to determine if it has failed.
+    rawSend(command, sizeof(command));
+    m_soundSequenceChunkEndTime = millis() + duration;
+}
+
+// This internal protected method is called from update() to send the next part of the sound sequence once the MiP
+// should have finished playing the previous one.
+void MiP::updateSoundSequence()
+{
+    if (!isSoundSequencePlaying() || (int32_t)(millis() - m_soundSequenceChunkEndTime) < 0)
+    {
+        return;
+    }
+
+    if (m_soundSequenceIndex >= m_soundSequenceLength)
+    {
+        m_pSoundSequence = NULL;
+        return;
+    }
+    sendSoundSequenceChunk();
+}
+
+bool MiP::queueSound(MiPSoundIndex sound, uint8_t priority /* = 0 */, MiPVolume volume /* = MIP_VOLUME_DEFAULT */)
+{
     m_lastError = MIP_ERROR_NONE;
+    if (!isSoundPlaying() && !isUnqueuedSoundPlaying())
+    {
+        startQueuedSound(sound, priority, volume);
+        return true;
+    }
+    if (isSoundPlaying() && priority > m_currentSoundPriority)
+    {
+        MiPSoundIndex interruptedSound = (MiPSoundIndex)m_currentSound;
+        startQueuedSound(sound, priority, volume);
+        notifySoundFinished(interruptedSound, true);
+        return true;
+    }
+
+    // Keep the queue sorted with the highest priority first and sounds of the same priority in the order queued. When
+    // the queue is full, the lowest priority sound at the end makes way for a higher priority one.
+    uint8_t index = m_soundQueueLength;
+    while (index > 0 && m_soundQueue[index - 1].priority < priority)
+    {
+        index--;
+    }
+    if (index == MIP_SOUND_QUEUE_SIZE)
+    {
+        return false;
+    }
+    uint8_t evictedSound = 0;
+    if (m_soundQueueLength == MIP_SOUND_QUEUE_SIZE)
+    {
+        m_soundQueueLength--;
+        evictedSound = m_soundQueue[m_soundQueueLength].sound;
+    }
+    memmove(&m_soundQueue[index + 1], &m_soundQueue[index], (m_soundQueueLength - index) * sizeof(m_soundQueue[0]));
+    m_soundQueue[index].sound = sound;
+    m_soundQueue[index].volume = volume;
+    m_soundQueue[index].priority = priority;
+    m_soundQueueLength++;
+
+    if (evictedSound != 0)
+    {
+        notifySoundFinished((MiPSoundIndex)evictedSound, true);
+    }
+    return true;
+}
+
+bool MiP::isSoundPlaying()
+{
+    return m_currentSound != 0;
+}
+
+uint8_t MiP::queuedSoundCount()
+{
+    return m_soundQueueLength;
+}
+
+void MiP::clearSoundQueue()
+{
+    // Empty the queue before letting the sketch know about any of the dropped sounds so that its callback sees the
+    // queue in a consistent state.
+    QueuedSound droppedSounds[MIP_SOUND_QUEUE_SIZE];
+    uint8_t     droppedCount = m_soundQueueLength;
+    memcpy(droppedSounds, m_soundQueue, droppedCount * sizeof(m_soundQueue[0]));
+    m_soundQueueLength = 0;
+
+    MiPSoundIndex interruptedSound = (MiPSoundIndex)m_currentSound;
+    if (isSoundPlaying())
+    {
+        m_currentSound = 0;
+        sendSound(MIP_SOUND_SHORT_MUTE_FOR_STOP, MIP_VOLUME_DEFAULT);
+        notifySoundFinished(interruptedSound, true);
+    }
+    for (uint8_t i = 0 ; i < droppedCount ; i++)
+    {
+        notifySoundFinished((MiPSoundIndex)droppedSounds[i].sound, true);
+    }
+}
+
+void MiP::onSoundFinished(MiPSoundFinishedCallback callback)
+{
+    m_callbacks.soundFinished = callback;
+}
+
+uint16_t MiP::estimateSoundDuration(MiPSoundIndex sound)
+{
+    return soundDuration(sound);
+}
+
+// This internal protected method plays a sound for the sound queue and records when it should be done playing.
+void MiP::startQueuedSound(MiPSoundIndex sound, uint8_t priority, MiPVolume volume)
+{
+    sendSound(sound, volume);
+    m_currentSound = sound;
+    m_currentSoundPriority = priority;
+    m_currentSoundEndTime = millis() + soundDuration(sound);
+}
+
+// This internal protected method lets the sketch know that a sound played by the sound queue is done. It is only
+// called once the queue is in a consistent state so that the callback can queue up more sounds.
+void MiP::notifySoundFinished(MiPSoundIndex sound, bool interrupted)
+{
+    if (m_callbacks.soundFinished)
+    {
+        m_callbacks.soundFinished(sound, interrupted);
+    }
+}
+
+// This internal protected method is called by playSoundList() and playSoundSequence() since the sounds that they send
+// to the MiP cut off the sound queue's current sound. The rest of the queue waits for them to finish.
+void MiP::interruptQueuedSound()
+{
+    if (!isSoundPlaying())
+    {
+        return;
+    }
+    MiPSoundIndex interruptedSound = (MiPSoundIndex)m_currentSound;
+    m_currentSound = 0;
+    notifySoundFinished(interruptedSound, true);
+}
+
+// This internal protected method returns whether the MiP should still be playing sounds sent by playSoundList() or
+// playSoundSequence().
+bool MiP::isUnqueuedSoundPlaying()
+{
+    if (m_isSoundListPlaying && (int32_t)(millis() - m_soundListEndTime) >= 0)
+    {
+        m_isSoundListPlaying = false;
+    }
+    return m_isSoundListPlaying || isSoundSequencePlaying();
+}
+
+// This internal protected method is called from update() to notice when the sound queue's current sound should have
+// finished and then start the next one waiting in the queue, once any sounds played outside of the queue are done.
+void MiP::updateSoundQueue()
+{
+    if (isSoundPlaying() && (int32_t)(millis() - m_currentSoundEndTime) < 0)
+    {
+        return;
+    }
+
+    MiPSoundIndex finishedSound = (MiPSoundIndex)m_currentSound;
+    m_currentSound = 0;
+    if (m_soundQueueLength > 0 && !isUnqueuedSoundPlaying())
+    {
+        QueuedSound next = m_soundQueue[0];
+        m_soundQueueLength--;
+        memmove(&m_soundQueue[0], &m_soundQueue[1], m_soundQueueLength * sizeof(m_soundQueue[0]));
+        startQueuedSound((MiPSoundIndex)next.sound, next.priority, (MiPVolume)next.volume);
+    }
+    if (finishedSound != 0)
+    {
+        notifySoundFinished(finishedSound, false);
+    }
 }
 
 void MiP::writeVolume(uint8_t volume)
 {
     int8_t result;
 
+    if (isSettingCached(MIP_CACHED_VOLUME) && m_cachedVolume == volume)
+    {
+        // The volume is already at this level so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_VOLUME);
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    uint8_t updatedVolume;
+    beginRetries();
+    do
     {
         rawSetVolume(volume);
 
         // Read back and make sure that it was set as expected.
-        uint8_t updatedVolume;
         result = rawGetVolume(updatedVolume);
-        if (result == MIP_ERROR_NONE && updatedVolume == volume)
+        if (result == MIP_ERROR_NONE && updatedVolume != volume)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read attempt.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read was successful but didn't match setting to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheVolume(updatedVolume);
     }
+    m_lastError = result;
+}
+
+void MiP::forceWriteVolume(uint8_t volume)
+{
+    // Forgetting the remembered setting means that writeVolume() can't skip the write.
+    uncacheSetting(MIP_CACHED_VOLUME);
+    writeVolume(volume);
 }
 
 uint8_t MiP::readVolume()
 {
     int8_t result;
 
+    if (isCachedSettingFresh(MIP_CACHED_VOLUME))
+    {
+        m_lastError = MIP_ERROR_NONE;
+        return m_cachedVolume;
+    }
+
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    uint8_t volume;
+    beginRetries();
+    do
     {
-        uint8_t volume;
         result = rawGetVolume(volume);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return volume;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
-    return 0;
+    if (result != MIP_ERROR_NONE)
+    {
+        return 0;
+    }
+    cacheVolume(volume);
+    return volume;
 }
 
 // This internal protected method sends the set volume command with no error checking. The error handling /
@@ -1157,7 +2537,7 @@ void MiP::rawSetVolume(uint8_t volume)
 int8_t MiP::rawGetVolume(uint8_t& volume)
 {
     const uint8_t getVolume[1] = { MIP_CMD_GET_VOLUME };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_VOLUME)];
     size_t        responseLength;
     int8_t        result;
 
@@ -1184,23 +2564,19 @@ float MiP::readDistanceTravelled()
     int8_t result;
 
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    float distance;
+    beginRetries();
+    do
     {
-        float distance;
         result = rawReadOdometer(distance);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return distance;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
-    return 0.0f;
+    if (result != MIP_ERROR_NONE)
+    {
+        return 0.0f;
+    }
+    return distance;
 }
 
 void MiP::resetDistanceTravelled()
@@ -1218,7 +2594,7 @@ void MiP::resetDistanceTravelled()
 int8_t MiP::rawReadOdometer(float& distanceInCm)
 {
     const uint8_t readOdometer[1] = { MIP_CMD_READ_ODOMETER };
-    uint8_t       response[1+4];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_READ_ODOMETER)];
     size_t        responseLength;
     uint32_t      ticks;
     int           result;
@@ -1301,7 +2677,7 @@ bool MiP::isOnBackWithKickstand()
 int8_t MiP::rawGetStatus(MiPStatus& status)
 {
     const uint8_t getStatus[1] = { MIP_CMD_GET_STATUS };
-    uint8_t       response[1+2];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_STATUS)];
     size_t        responseLength;
     int           result;
 
@@ -1318,7 +2694,7 @@ int8_t MiP::rawGetStatus(MiPStatus& status)
 // packs the result into a MiPStatus class.
 int8_t MiP::parseStatus(MiPStatus& status, const uint8_t response[], size_t responseLength)
 {
-    if (responseLength != 3 ||
+    if (responseLength != MIP_RESPONSE_LENGTH(MIP_CMD_GET_STATUS) ||
         response[0] != MIP_CMD_GET_STATUS ||
         response[2] > MIP_POSITION_ON_BACK_WITH_KICKSTAND)
     {
@@ -1347,26 +2723,22 @@ int8_t MiP::readWeight()
     // Haven't seen a weight event yet so request the weight explicitly.
     // Retry the read if it should fail on the first attempt.
     int8_t result;
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    int8_t weight;
+    beginRetries();
+    do
     {
-        int8_t weight;
         result = rawGetWeight(weight);
-        if (result == MIP_ERROR_NONE)
-        {
-            // Cache the returned value and return it to the caller.
-            m_lastError = MIP_ERROR_NONE;
-            m_lastWeight = weight;
-            m_flags |= MIP_FLAG_WEIGHT_VALID;
-            return weight;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
-    return 0.0f;
+    if (result != MIP_ERROR_NONE)
+    {
+        return 0.0f;
+    }
+    // Cache the returned value and return it to the caller.
+    m_lastWeight = weight;
+    m_flags |= MIP_FLAG_WEIGHT_VALID;
+    return weight;
 }
 
 // This internal protected method sends the get weight command with minimal error handling. The error
@@ -1374,7 +2746,7 @@ int8_t MiP::readWeight()
 int8_t MiP::rawGetWeight(int8_t& weight)
 {
     const uint8_t getWeight[1] = { MIP_CMD_GET_WEIGHT };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_WEIGHT)];
     size_t        responseLength;
     int           result;
 
@@ -1390,7 +2762,7 @@ int8_t MiP::rawGetWeight(int8_t& weight)
 // This internal protected method takes the weight response and validates it.
 int8_t MiP::parseWeight(int8_t& weight, const uint8_t response[], size_t responseLength)
 {
-    if (responseLength != 2 ||
+    if (responseLength != MIP_RESPONSE_LENGTH(MIP_CMD_GET_WEIGHT) ||
         response[0] != MIP_CMD_GET_WEIGHT)
     {
         return MIP_ERROR_BAD_RESPONSE;
@@ -1417,72 +2789,70 @@ void MiP::checkedEnableClapEvents(MiPClapEnabled enabled)
 {
     int8_t result;
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    if (isSettingCached(MIP_CACHED_CLAP_SETTINGS) && m_cachedClapSettings.enabled == enabled)
+    {
+        // Clap events are already enabled/disabled as requested so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_CLAP_SETTINGS);
+
+    MiPClapSettings setting;
+    beginRetries();
+    do
     {
         rawEnableClap(enabled);
 
         // Read back and make sure that it was set as expected.
-        MiPClapSettings setting;
         result = rawGetClapSettings(setting);
-        if (result == MIP_ERROR_NONE && setting.enabled == enabled)
+        if (result == MIP_ERROR_NONE && setting.enabled != enabled)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read back routine.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read back was successful but write didn't take.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheClapSettings(setting);
     }
+    m_lastError = result;
 }
 
 void MiP::writeClapDelay(uint16_t delayTime)
 {
     int8_t result;
 
+    if (isSettingCached(MIP_CACHED_CLAP_SETTINGS) && m_cachedClapSettings.delay == delayTime)
+    {
+        // The clap delay is already set to this value so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    uncacheSetting(MIP_CACHED_CLAP_SETTINGS);
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    MiPClapSettings setting;
+    beginRetries();
+    do
     {
         rawSetClapDelay(delayTime);
 
         // Read back and make sure that it was set as expected.
-        MiPClapSettings setting;
         result = rawGetClapSettings(setting);
-        if (result == MIP_ERROR_NONE && setting.delay == delayTime)
+        if (result == MIP_ERROR_NONE && setting.delay != delayTime)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from read back routine.
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // Read back was successful but write didn't take.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheClapSettings(setting);
     }
+    m_lastError = result;
 }
 
 // This internal protected method sends the enable/disable clap command with no error checking. The error handling /
@@ -1545,22 +2915,26 @@ int8_t MiP::readClapSettings(MiPClapSettings& settings)
 {
     int8_t result;
 
+    if (isCachedSettingFresh(MIP_CACHED_CLAP_SETTINGS))
+    {
+        settings = m_cachedClapSettings;
+        return MIP_ERROR_NONE;
+    }
+
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    beginRetries();
+    do
     {
         result = rawGetClapSettings(settings);
-        if (result == MIP_ERROR_NONE)
-        {
-            return MIP_ERROR_NONE;
-        }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+    if (result != MIP_ERROR_NONE)
+    {
+        settings.clear();
+        return result;
     }
-
-    settings.clear();
-    return result;
+    cacheClapSettings(settings);
+    return MIP_ERROR_NONE;
 }
 
 uint8_t MiP::availableClapEvents()
@@ -1573,11 +2947,17 @@ uint8_t MiP::availableClapEvents()
 }
 
 uint8_t MiP::readClapEvent()
+{
+    uint16_t arrivalTime;
+    return readClapEvent(arrivalTime);
+}
+
+uint8_t MiP::readClapEvent(uint16_t& arrivalTime)
 {
     // Fetch bytes from the Serial receive buffer and process any event data found within.
     processAllResponseData();
 
-    uint8_t clapEvent = 0;
+    TimedEvent<uint8_t> clapEvent;
     if (!m_clapEvents.pop(clapEvent))
     {
         // No clap event has been received yet.
@@ -1585,7 +2965,14 @@ uint8_t MiP::readClapEvent()
         return 0;
     }
     m_lastError = MIP_ERROR_NONE;
-    return clapEvent;
+    arrivalTime = clapEvent.arrivalTime;
+    return clapEvent.value;
+}
+
+uint16_t MiP::droppedClapEvents()
+{
+    m_lastError = MIP_ERROR_NONE;
+    return m_clapEvents.droppedCount();
 }
 
 // This internal protected method sends the get clap settings command with minimal error handling. The error
@@ -1593,7 +2980,7 @@ uint8_t MiP::readClapEvent()
 int8_t MiP::rawGetClapSettings(MiPClapSettings& settings)
 {
     const uint8_t getClapSettings[1] = { MIP_CMD_GET_CLAP_SETTINGS };
-    uint8_t       response[1+3];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_CLAP_SETTINGS)];
     size_t        responseLength;
     int8_t        result;
 
@@ -1638,19 +3025,11 @@ void MiP::readSoftwareVersion(MiPSoftwareVersion& software)
     int8_t result;
 
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    beginRetries();
+    do
     {
         result = rawGetSoftwareVersion(software);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
 }
@@ -1660,19 +3039,11 @@ void MiP::readHardwareInfo(MiPHardwareInfo& hardware)
     int8_t result;
 
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    beginRetries();
+    do
     {
         result = rawGetHardwareInfo(hardware);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
 }
@@ -1682,7 +3053,7 @@ void MiP::readHardwareInfo(MiPHardwareInfo& hardware)
 int8_t MiP::rawGetSoftwareVersion(MiPSoftwareVersion& software)
 {
     const uint8_t getSoftwareVersion[1] = { MIP_CMD_GET_SOFTWARE_VERSION };
-    uint8_t       response[1+4];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_SOFTWARE_VERSION)];
     size_t        responseLength;
     int8_t        result;
 
@@ -1709,7 +3080,7 @@ int8_t MiP::rawGetSoftwareVersion(MiPSoftwareVersion& software)
 int8_t MiP::rawGetHardwareInfo(MiPHardwareInfo& hardware)
 {
     const uint8_t getHardwareInfo[1] = { MIP_CMD_GET_HARDWARE_INFO };
-    uint8_t       response[1+2];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_HARDWARE_INFO)];
     size_t        responseLength;
     int8_t        result;
 
@@ -1795,22 +3166,25 @@ bool MiP::checkGameMode(MiPGameMode expectedMode)
 {
     int8_t result;
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    if (isCachedSettingFresh(MIP_CACHED_GAME_MODE))
+    {
+        return m_cachedGameMode == expectedMode;
+    }
+
+    MiPGameMode currentMode;
+    beginRetries();
+    do
     {
-        MiPGameMode currentMode;
         result = rawGetGameMode(currentMode);
-        if (result == MIP_ERROR_NONE)
-        {
-            return currentMode == expectedMode;
-        }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
+    if (result != MIP_ERROR_NONE)
+    {
+        m_lastError = result;
+        return false;
     }
-
-    m_lastError = result;
-    return false;
+    cacheGameMode(currentMode);
+    return currentMode == expectedMode;
 }
 
 // This internal protected method sends the command to change the game mode and then sends a request to get
@@ -1819,35 +3193,37 @@ void MiP::verifiedSetGameMode(MiPGameMode desiredMode)
 {
     int8_t result;
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    if (isSettingCached(MIP_CACHED_GAME_MODE) && m_cachedGameMode == desiredMode)
+    {
+        // Already in the desired mode so there is nothing to send.
+        m_lastError = MIP_ERROR_NONE;
+        return;
+    }
+    // The game modes drive the LEDs themselves so the cached LED settings can't be trusted after switching modes.
+    uncacheSetting(MIP_CACHED_GAME_MODE);
+    uncacheSetting(MIP_CACHED_CHEST_LED);
+    uncacheSetting(MIP_CACHED_HEAD_LEDS);
+
+    MiPGameMode actualMode;
+    beginRetries();
+    do
     {
         rawSetGameMode(desiredMode);
 
         // Read back and make sure that it was set as expected.
-        MiPGameMode actualMode;
         result = rawGetGameMode(actualMode);
-        if (result == MIP_ERROR_NONE && actualMode == desiredMode)
+        if (result == MIP_ERROR_NONE && actualMode != desiredMode)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from rawGetGameMode().
-        m_lastError = result;
-    }
-    else
+    if (result == MIP_ERROR_NONE)
     {
-        // rawGetGameMode() was successful but didn't match mode to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
+        cacheGameMode(actualMode);
     }
+    m_lastError = result;
 }
 
 // This internal protected method sends the set game mode command with no error checking. The error handling /
@@ -1869,7 +3245,7 @@ void MiP::rawSetGameMode(MiPGameMode mode)
 int8_t MiP::rawGetGameMode(MiPGameMode& mode)
 {
     const uint8_t getGameMode[1] = { MIP_CMD_GET_GAME_MODE };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_GAME_MODE)];
     size_t        responseLength;
     int8_t        result;
 
@@ -1881,7 +3257,7 @@ int8_t MiP::rawGetGameMode(MiPGameMode& mode)
     {
         return result;
     }
-    if (responseLength != 2 ||
+    if (responseLength != sizeof(response) ||
         response[0] != MIP_CMD_GET_GAME_MODE ||
         (response[1] != MIP_APP_MODE &&
          response[1] != MIP_CAGE_MODE &&
@@ -1915,35 +3291,22 @@ void MiP::setUserData(uint8_t addressOffset, uint8_t userData)
     int8_t result;
 
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    byte storedData = 0x00;
+    beginRetries();
+    do
     {
         rawSetUserData(address, userData);
 
         // Read back and make sure that it was set as expected.
-        byte storedData = 0x00;
         result = rawGetUserData(address, storedData);
-        if (result == MIP_ERROR_NONE && storedData == userData)
+        if (result == MIP_ERROR_NONE && storedData != userData)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from rawGetUserData().
-        m_lastError = result;
-    }
-    else
-    {
-        // rawGetUserData() was successful but didn't match the data we were expecting.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
-    }
+    m_lastError = result;
 }
 
 uint8_t MiP::getUserData(uint8_t addressOffset)
@@ -1956,23 +3319,19 @@ uint8_t MiP::getUserData(uint8_t addressOffset)
    int8_t result;
 
     // Retry the read if it should fail on the first attempt.
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    uint8_t storedData;
+    beginRetries();
+    do
     {
-        uint8_t storedData;
         result = rawGetUserData(address, storedData);
-        if (result == MIP_ERROR_NONE)
-        {
-            m_lastError = MIP_ERROR_NONE;
-            return storedData;
-        }
-
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
+    } while (shouldRetry(result));
 
     m_lastError = result;
-    return 0;
+    if (result != MIP_ERROR_NONE)
+    {
+        return 0;
+    }
+    return storedData;
 }
 
 // This internal protected method sends the set user data command with no error checking.
@@ -1993,7 +3352,7 @@ int8_t MiP::rawGetUserData(uint8_t address, uint8_t& userData)
 {
     uint8_t getUserData[1+1] = { MIP_CMD_GET_USER_DATA };
     getUserData[1] = address;
-    uint8_t       response[1+2];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_USER_DATA)];
     size_t        responseLength;
     int8_t        result;
 
@@ -2002,7 +3361,7 @@ int8_t MiP::rawGetUserData(uint8_t address, uint8_t& userData)
     {
         return result;
     }
-    if (responseLength != 3 ||
+    if (responseLength != sizeof(response) ||
         response[0] != MIP_CMD_GET_USER_DATA ||
         response[1] != address)
     {
@@ -2036,18 +3395,25 @@ bool MiP::isMiPDetectionModeEnabled()
 }
 
 uint8_t MiP::readDetectedMiP()
+{
+    uint16_t arrivalTime;
+    return readDetectedMiP(arrivalTime);
+}
+
+uint8_t MiP::readDetectedMiP(uint16_t& arrivalTime)
 {
     // Fetch bytes from the Serial receive buffer and process any event data found within.
     processAllResponseData();
 
-    uint8_t detectedMiPEvent = 0;
+    TimedEvent<uint8_t> detectedMiPEvent;
     if(!m_detectedMiPEvents.pop(detectedMiPEvent))
     {
         m_lastError = MIP_ERROR_NO_EVENT;
-        return detectedMiPEvent;
+        return 0;
     }
     m_lastError = MIP_ERROR_NONE;
-    return detectedMiPEvent;
+    arrivalTime = detectedMiPEvent.arrivalTime;
+    return detectedMiPEvent.value;
 }
 
 uint8_t MiP::availableDetectedMiPEvents()
@@ -2058,6 +3424,12 @@ uint8_t MiP::availableDetectedMiPEvents()
     return m_detectedMiPEvents.available();
 }
 
+uint16_t MiP::droppedDetectedMiPEvents()
+{
+    m_lastError = MIP_ERROR_NONE;
+    return m_detectedMiPEvents.droppedCount();
+}
+
 // This internal protected method sends the set detection mode command with minimal error
 // handling. The error recovery happens at a higher level of the driver.
 void MiP::rawSetMiPDetectionMode(uint8_t id, uint8_t txPower)
@@ -2086,7 +3458,7 @@ void MiP::disableIRRemoteControl()
 bool MiP::isIRRemoteControlEnabled()
 {
     const uint8_t remoteControlEnabled[1] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_IR_REMOTE_CONTROL)];
     size_t        responseLength;
     int8_t        result;
 
@@ -2121,18 +3493,25 @@ void MiP::sendIRDongleCode(uint16_t sendCode, uint8_t transmitPower)
 }
 
 uint32_t MiP::readIRDongleCode()
+{
+    uint16_t arrivalTime;
+    return readIRDongleCode(arrivalTime);
+}
+
+uint32_t MiP::readIRDongleCode(uint16_t& arrivalTime)
 {
     // Fetch bytes from the Serial receive buffer and process any event data found within.
     processAllResponseData();
 
-    uint32_t irCodeEvent = 0xFFFFFFFF;
+    TimedEvent<uint32_t> irCodeEvent;
     if (!m_irCodeEvents.pop(irCodeEvent))
     {
         m_lastError = MIP_ERROR_NO_EVENT;
-        return irCodeEvent;
+        return 0xFFFFFFFF;
     }
     m_lastError = MIP_ERROR_NONE;
-    return irCodeEvent;
+    arrivalTime = irCodeEvent.arrivalTime;
+    return irCodeEvent.value;
 }
 
 uint8_t MiP::availableIRCodeEvents()
@@ -2143,40 +3522,33 @@ uint8_t MiP::availableIRCodeEvents()
     return m_irCodeEvents.available();
 }
 
+uint16_t MiP::droppedIRCodeEvents()
+{
+    m_lastError = MIP_ERROR_NONE;
+    return m_irCodeEvents.droppedCount();
+}
+
 // This internal protected method verifies that IR remote control is enabled.
 void MiP::verifiedIRRemoteControl(uint8_t desiredRemoteControlMode)
 {
     int8_t result;
 
-    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    uint8_t actualMode;
+    beginRetries();
+    do
     {
         rawSetIRRemoteControl(desiredRemoteControlMode);
 
         // Read back and make sure that it was set as expected.
-        uint8_t actualMode;
         result = rawGetIRRemoteControl(actualMode);
-        if (result == MIP_ERROR_NONE && actualMode == desiredRemoteControlMode)
+        if (result == MIP_ERROR_NONE && actualMode != desiredRemoteControlMode)
         {
-            // The set was successful so return immediately.
-            m_lastError = MIP_ERROR_NONE;
-            return;
+            // Read was successful but didn't match setting to which we were attempting to change.
+            result = MIP_ERROR_MAX_RETRIES;
         }
+    } while (shouldRetry(result));
 
-        // An error was encountered so we will loop around and try again.
-        // Wait for a bit before the next retry.
-        delay(MIP_RETRY_WAIT);
-    }
-
-    if (result != MIP_ERROR_NONE)
-    {
-        // Kept getting an error back from rawGetGameMode().
-        m_lastError = result;
-    }
-    else
-    {
-        // rawGetGameMode() was successful but didn't match mode to which we were attempting to change.
-        m_lastError = MIP_ERROR_MAX_RETRIES;
-    }
+    m_lastError = result;
 }
 
 // This internal protected method sends the set IR remote control command with minimal error
@@ -2198,7 +3570,7 @@ void MiP::rawSetIRRemoteControl(uint8_t remoteControl)
 int8_t MiP::rawGetIRRemoteControl(uint8_t& remoteControl)
 {
     const uint8_t getIRRemoteControl[1] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
-    uint8_t       response[1+1];
+    uint8_t       response[MIP_RESPONSE_LENGTH(MIP_CMD_GET_IR_REMOTE_CONTROL)];
     size_t        responseLength;
     int8_t        result;
 
@@ -2227,6 +3599,11 @@ void MiP::rawSend(const uint8_t request[], size_t requestLength)
 int8_t MiP::rawReceive(const uint8_t request[], size_t requestLength,
                           uint8_t responseBuffer[], size_t responseBufferSize, size_t& responseLength)
 {
+    // Transports which decode frames themselves, like MiPIsrTransport, get the length of each frame from
+    // g_mipCommandInfo as it arrives so they can only receive responses to the commands listed there.
+    MIP_ASSERT( !m_pTransport->decodesFrames() ||
+                (mipDescriptorFlags(mipLookupCommandDescriptor(request[0])) & MIP_CMD_FLAG_RESPONSE) );
+
     transportSendRequest(request, requestLength, MIP_EXPECT_RESPONSE);
     return transportGetResponse(responseBuffer, responseBufferSize, &responseLength);
 }
@@ -2238,10 +3615,41 @@ void MiP::transportSendRequest(const uint8_t* pRequest, size_t requestLength, in
     // Must call begin() and have it return 'true' before calling sending commands to the MiP.
     MIP_ASSERT( isInitialized() );
 
-    switchSerialToMiP();
+    // Caller is attempting to send a request that is larger than supported by the MiP and this library.
+    MIP_ASSERT( requestLength <= MIP_REQUEST_MAX_LEN );
+
+    if (areAsyncRequestsEnabled() && !expectResponse)
+    {
+        // Requests that don't expect a response can just be sent later from update() if the MiP isn't ready for them
+        // yet. They still need to go out in order though so only send immediately if nothing else is queued up.
+        if (m_requestQueue.isEmpty() && transportIsReadyForRequest())
+        {
+            transportWriteRequest(pRequest, requestLength);
+            return;
+        }
+
+        if (m_requestQueue.isFull())
+        {
+            // No room left in the queue so block until the oldest request can be sent, which is only one request
+            // delay away. The caller has no way to retry a dropped request later so this is better than failing.
+            while (!transportIsReadyForRequest())
+            {
+            }
+            transportSendQueuedRequests();
+        }
+
+        QueuedRequest request;
+        request.length = requestLength;
+        memcpy(request.data, pRequest, requestLength);
+        m_requestQueue.push(request);
+        return;
+    }
+
+    // Any previously queued requests must be sent to the MiP before this one.
+    transportFlushRequestQueue();
 
     // Let the MiP process the last request before letting another request be issued.
-    while (millis() - m_lastRequestTime < MIP_REQUEST_DELAY)
+    while (!transportIsReadyForRequest())
     {
     }
 
@@ -2258,13 +3666,83 @@ void MiP::transportSendRequest(const uint8_t* pRequest, size_t requestLength, in
     m_expectedResponseSize = 0;
     m_responseBuffer[0] = 0;
 
-    // Send the specified bytes to the MiP via the UART.
-    while (requestLength-- > 0)
+    transportWriteRequest(pRequest, requestLength);
+}
+
+bool MiP::transportIsReadyForRequest()
+{
+    // m_lastRequestTime can be in the future while the last request is still being transmitted so compare as signed.
+    return (int32_t)(micros() - m_lastRequestTime) >= (int32_t)m_requestDelay;
+}
+
+void MiP::transportWriteRequest(const uint8_t* pRequest, size_t requestLength)
+{
+    switchSerialToMiP();
+
+    // Send the specified bytes to the MiP via the transport.
+    for (size_t i = 0 ; i < requestLength ; i++)
+    {
+        m_pTransport->write(pRequest[i]);
+    }
+    statsRecordRequest(pRequest[0]);
+    traceRecord(0, pRequest, requestLength);
+
+    // The transport typically just queues the bytes up so note when the last of them will actually have been sent.
+    m_lastRequestTime = micros() + transportTransmitTime(requestLength);
+}
+
+// This internal protected method returns the number of microseconds it takes to send this many bytes over the UART
+// at the current baud rate (8-N-1 so 10 bits per byte).
+uint32_t MiP::transportTransmitTime(size_t byteCount)
+{
+    return (byteCount * 10000000UL) / m_mipBaudRate;
+}
+
+// This internal protected method is called with the number of microseconds that it took the MiP to start responding to
+// the last request. This latency is used to tune the delay between requests to the speed of the connected MiP.
+void MiP::transportUpdateRequestDelay(uint32_t responseLatency)
+{
+    if (responseLatency > MIP_MAX_REQUEST_DELAY)
+    {
+        responseLatency = MIP_MAX_REQUEST_DELAY;
+    }
+    m_responseLatency = m_responseLatency - m_responseLatency / 8 + responseLatency / 8;
+    if (m_flags & MIP_FLAG_REQUEST_DELAY_PINNED)
+    {
+        return;
+    }
+
+    // Give the MiP twice as long as it typically takes to respond before sending it another request.
+    uint32_t requestDelay = 2 * (uint32_t)m_responseLatency;
+    if (requestDelay < MIP_MIN_REQUEST_DELAY)
+    {
+        requestDelay = MIP_MIN_REQUEST_DELAY;
+    }
+    if (requestDelay > MIP_MAX_REQUEST_DELAY)
+    {
+        requestDelay = MIP_MAX_REQUEST_DELAY;
+    }
+    m_requestDelay = requestDelay;
+}
+
+void MiP::transportSendQueuedRequests()
+{
+    // Only send as many of the queued requests as the MiP is ready to accept right now.
+    QueuedRequest request;
+    while (!m_requestQueue.isEmpty() && transportIsReadyForRequest())
     {
-        Serial.write(*pRequest++);
+        m_requestQueue.pop(request);
+        transportWriteRequest(request.data, request.length);
     }
+}
 
-    m_lastRequestTime = millis();
+void MiP::transportFlushRequestQueue()
+{
+    // Wait for all of the queued requests to be sent to the MiP.
+    while (!m_requestQueue.isEmpty())
+    {
+        transportSendQueuedRequests();
+    }
 }
 
 int8_t MiP::transportGetResponse(uint8_t* pResponseBuffer, size_t responseBufferSize, size_t* pResponseLength)
@@ -2292,10 +3770,17 @@ int8_t MiP::transportGetResponse(uint8_t* pResponseBuffer, size_t responseBuffer
     if (!responseFound)
     {
         // Never received the expected response within the timeout window.
-        MiPStream.println(F("MiP: Response timeout"));
+        mipLog(MIP_LOG_RESPONSE_TIMEOUT, m_expectedResponseCommand);
+        statsRecordTimeout(m_expectedResponseCommand);
         return MIP_ERROR_TIMEOUT;
     }
 
+    // Don't count the time taken to transmit the hex text of the response itself in the MiP's response latency.
+    int32_t elapsedTime = (int32_t)(micros() - m_lastRequestTime);
+    int32_t responseLatency = elapsedTime - transportTransmitTime(2 * m_expectedResponseSize);
+    transportUpdateRequestDelay(responseLatency > 0 ? responseLatency : 0);
+    statsRecordResponse(m_expectedResponseCommand, elapsedTime > 0 ? elapsedTime : 0);
+
     // Copy reponse data into caller provided buffer and clear state in transport about the expected response.
     memcpy(pResponseBuffer, m_responseBuffer, m_expectedResponseSize);
     *pResponseLength = m_expectedResponseSize;
@@ -2303,237 +3788,617 @@ int8_t MiP::transportGetResponse(uint8_t* pResponseBuffer, size_t responseBuffer
     m_expectedResponseSize = 0;
     m_responseBuffer[0] = 0;
 
-    return MIP_ERROR_NONE;
+    return MIP_ERROR_NONE;
+}
+
+bool MiP::processAllResponseData()
+{
+    bool responseFound = false;
+
+    switchSerialToMiP();
+
+    // Throw away any partially received frame if the rest of it hasn't shown up in a reasonable amount of time.
+    if (isResponseFrameInProgress() && millis() - m_rxLastDigitTime >= MIP_RESPONSE_TIMEOUT)
+    {
+        mipLog(m_rxFlags & MIP_RX_FLAG_RESPONSE ? MIP_LOG_RESPONSE_TOO_SHORT : MIP_LOG_OOB_TOO_SHORT,
+               m_rxFrameLength, m_rxFrameSize);
+        skipResponseDigits(m_rxFrameLength * 2 + (m_rxHighDigit != 0));
+        resetResponseDecoder();
+    }
+
+    if (m_pTransport->decodesFrames())
+    {
+        return processDecodedFrames();
+    }
+
+    if (m_pTransport->available() <= 0)
+    {
+        // Nothing new to decode.
+        return false;
+    }
+
+    // Decode the hex text sent from the MiP one digit at a time. Any partial frame left over when the transport runs
+    // out of received data is kept around so that decoding can pick up where it left off on the next call.
+    while (m_pTransport->available() > 0)
+    {
+        // Take the fast path and decode the rest of the frame in one go if all of its digits have already arrived.
+        uint8_t remainingBytes = m_rxFrameSize - m_rxFrameLength;
+        if (m_rxHighDigit == 0 && remainingBytes > 1 && m_pTransport->available() >= remainingBytes * 2)
+        {
+            uint8_t digits[(MIP_RESPONSE_MAX_LEN - 1) * 2];
+            for (uint8_t i = 0 ; i < remainingBytes * 2 ; i++)
+            {
+                digits[i] = m_pTransport->read();
+            }
+            if (copyHexTextToBinary(&m_rxFrame[m_rxFrameLength], digits, remainingBytes))
+            {
+                m_rxFrameLength += remainingBytes;
+                if (processCompletedFrame())
+                {
+                    responseFound = true;
+                }
+                // A frame that made no sense leaves its digits queued up to be decoded again. They were received
+                // before anything still waiting in the transport so they must be decoded first.
+                if (processReplayedDigits())
+                {
+                    responseFound = true;
+                }
+                continue;
+            }
+
+            // Let the slower path figure out which of these digits need to be skipped.
+            for (uint8_t i = 0 ; i < remainingBytes * 2 ; i++)
+            {
+                if (processResponseDigit(digits[i]))
+                {
+                    responseFound = true;
+                }
+            }
+            continue;
+        }
+
+        if (processResponseDigit(m_pTransport->read()))
+        {
+            // Continue to process any other bytes in the recieve buffer.
+            // This would allow something like a rawGetStatus() call to receive the actual data returned for this
+            // request and not an older OOB perioidic status notification.
+            responseFound = true;
+        }
+    }
+    m_rxLastDigitTime = millis();
+
+    return responseFound;
+}
+
+// This internal protected method handles the frames that were already decoded by transports like MiPIsrTransport. It
+// returns true if one of them was the response to the last request.
+bool MiP::processDecodedFrames()
+{
+    bool    responseFound = false;
+    uint8_t frameLength;
+
+    while ((frameLength = m_pTransport->readFrame(m_rxFrame, sizeof(m_rxFrame), m_rxFrameArrivalTime)) > 0)
+    {
+        resetResponseDecoder();
+        m_rxFrameLength = frameLength;
+        m_rxFrameSize = frameLength;
+        if (m_expectedResponseCommand != 0 && m_rxFrame[0] == m_expectedResponseCommand &&
+            frameLength == m_expectedResponseSize)
+        {
+            m_rxFlags |= MIP_RX_FLAG_RESPONSE;
+        }
+        else if ((mipDescriptorFlags(mipLookupCommandDescriptor(m_rxFrame[0])) & MIP_CMD_FLAG_OOB) == 0)
+        {
+            // A response to an earlier request which is no longer being waited upon.
+            skipResponseDigits(frameLength * 2);
+            resetResponseDecoder();
+            continue;
+        }
+
+        if (processCompletedFrame())
+        {
+            responseFound = true;
+        }
+        if (m_rxReplayLength > 0)
+        {
+            // The frame made no sense but there is no hex text to resync with since it was decoded as a whole.
+            skipResponseDigits(m_rxReplayLength);
+            m_rxReplayIndex = 0;
+            m_rxReplayLength = 0;
+        }
+    }
+    resetResponseDecoder();
+
+    return responseFound;
+}
+
+// This internal protected method decodes the next hex digit received from the MiP along with any digits that
+// resyncResponseDecoder() queued up to be decoded again. It returns true once the response to the last request has
+// been fully received.
+bool MiP::processResponseDigit(uint8_t digit)
+{
+    // Digits queued up by an earlier resync were received before this one so they are decoded first.
+    bool responseFound = processReplayedDigits();
+
+    if (decodeResponseDigit(digit))
+    {
+        responseFound = true;
+    }
+    if (processReplayedDigits())
+    {
+        responseFound = true;
+    }
+
+    return responseFound;
 }
 
-bool MiP::processAllResponseData()
+// This internal protected method decodes the digits that resyncResponseDecoder() queued up to be decoded again,
+// including any queued up by further resyncs along the way. It returns true if they completed the response to the last
+// request.
+bool MiP::processReplayedDigits()
 {
-    bool    responseFound = false;
-    uint8_t buffer[(MIP_RESPONSE_MAX_LEN - 1) * 2];
-    size_t  bytesToRead;
-    size_t  bytesRead;
-
-    switchSerialToMiP();
+    bool responseFound = false;
 
-    while (Serial.available() >= 2)
+    while (m_rxReplayIndex < m_rxReplayLength)
     {
-        uint8_t highNibble = Serial.read();
-        uint8_t lowNibble = Serial.read();
-        uint8_t commandByte = (parseHexDigit(highNibble) << 4) | parseHexDigit(lowNibble);
-
-        if (m_expectedResponseCommand != 0 && commandByte == m_expectedResponseCommand)
-        {
-            // Store away the command byte that we just read into response buffer so that it isn't lost.
-            m_responseBuffer[0] = commandByte;
-
-            // Already read the command byte into element 0 of the response buffer earlier so just need to read in the
-            // rest of the expected response bytes now.
-            bytesToRead = m_expectedResponseSize - 1;
-            bytesRead = Serial.readBytes(buffer, bytesToRead * 2);
-            if (bytesRead == bytesToRead * 2)
-            {
-                copyHexTextToBinary(&m_responseBuffer[1], buffer, bytesToRead);
-                responseFound = true;
-                // Continue to process any other bytes in the recieve buffer.
-                // This would allow something like a rawGetStatus() call to receive the actual data returned for this
-                // request and not an older OOB perioidic status notification.
-            }
-            else
-            {
-                // Timed out waiting for all of the response data.
-                m_expectedResponseCommand = 0;
-                m_expectedResponseSize = 0;
-                m_responseBuffer[0] = 0;
-                MiPStream.print(F("MiP: Response too short: "));
-                    MiPStream.print(bytesRead);
-                    MiPStream.print(',');
-                    MiPStream.println(bytesToRead * 2);
-                break;
-            }
-        }
-        else
+        if (decodeResponseDigit(m_rxReplay[m_rxReplayIndex++]))
         {
-            processOobResponseData(commandByte);
+            responseFound = true;
         }
     }
+    m_rxReplayIndex = 0;
+    m_rxReplayLength = 0;
 
     return responseFound;
 }
 
-void MiP::copyHexTextToBinary(uint8_t* pDest, uint8_t* pSrc, uint8_t length)
+// This internal protected method pairs up hex digits into bytes and adds them to the frame being assembled.
+bool MiP::decodeResponseDigit(uint8_t digit)
 {
-    while (length-- > 0)
+    uint8_t lowNibble = mipParseHexDigit(digit);
+    if (lowNibble == MIP_INVALID_HEX_DIGIT)
     {
-        *pDest = (parseHexDigit(pSrc[0]) << 4) | parseHexDigit(pSrc[1]);
-        pDest++;
-        pSrc+=2;
+        // A character which isn't a hex digit can't be part of any frame so just step over it.
+        skipResponseDigits(1);
+        return false;
+    }
+    if (m_rxHighDigit == 0)
+    {
+        if (m_rxFrameLength == 0)
+        {
+            // First digit of a new frame. Notifications are stamped with this time rather than when they are complete.
+            m_rxFrameArrivalTime = (uint16_t)millis();
+        }
+        m_rxHighDigit = digit;
+        return false;
     }
+    uint8_t highNibble = mipParseHexDigit(m_rxHighDigit);
+    m_rxHighDigit = 0;
+
+    return processResponseByte((highNibble << 4) | lowNibble);
 }
 
-uint8_t MiP::parseHexDigit(uint8_t digit)
+// This internal protected method adds the next byte decoded from the MiP's hex text to the frame being assembled. It
+// returns true once the response to the last request has been fully received.
+bool MiP::processResponseByte(uint8_t byte)
 {
-    if (digit >= '0' && digit <= '9')
-    {
-        return digit - '0';
-    }
-    else if (digit >= 'a' && digit <= 'f')
+    m_rxFrame[m_rxFrameLength++] = byte;
+
+    if (m_rxFrameLength == 1)
     {
-        return digit - 'a' + 10;
+        // The first byte of the frame is the command byte which determines how many bytes make up the rest of the frame.
+        if (m_expectedResponseCommand != 0 && m_expectedResponseSize != 0 && byte == m_expectedResponseCommand)
+        {
+            m_rxFlags |= MIP_RX_FLAG_RESPONSE;
+            m_rxFrameSize = m_expectedResponseSize;
+        }
+        else
+        {
+            uint16_t descriptor = mipLookupCommandDescriptor(byte);
+            uint8_t  flags = mipDescriptorFlags(descriptor);
+            if ((flags & MIP_CMD_FLAG_OOB) == 0)
+            {
+                // Not the start of a frame so the receiver must be out of sync with the MiP.
+                resyncResponseDecoder();
+                return false;
+            }
+            if (flags & MIP_CMD_FLAG_VARIABLE_LENGTH)
+            {
+                m_rxFlags |= MIP_RX_FLAG_VARIABLE_LENGTH;
+            }
+            m_rxFrameSize = 1 + mipDescriptorResponseLength(descriptor);
+        }
     }
-    else if (digit >= 'A' && digit <= 'F')
+    else if (m_rxFrameLength == 2 && (m_rxFlags & MIP_RX_FLAG_VARIABLE_LENGTH))
     {
-        return digit - 'A' + 10;
+        // MIP_CMD_RECEIVE_IR_DONGLE_CODE is the only message delivered by MiP that has a
+        // variable length so the second byte contains the length of the rest of the frame.
+        uint8_t length = byte;
+        if (length < 2 || length > 4)
+        {
+            resyncResponseDecoder();
+            return false;
+        }
+        m_rxFrameSize = 2 + length;
     }
-    else
+
+    if (m_rxFrameLength < m_rxFrameSize)
     {
-        return 0;
+        // Need more bytes before this frame is complete.
+        return false;
     }
+
+    return processCompletedFrame();
 }
 
-void MiP::processOobResponseData(uint8_t commandByte)
+// This internal protected method hands off a fully received frame to be processed as either the response to the last
+// request or an out of band notification. It returns true if it was the response to the last request.
+bool MiP::processCompletedFrame()
 {
-    size_t length = 0;
-    size_t bytesRead;
-
-    // The number of additional bytes to read depends on which notification has been found in serial buffer.
-    switch (commandByte)
+    bool responseFound = false;
+    if (m_rxFlags & MIP_RX_FLAG_RESPONSE)
     {
-    case MIP_CMD_GET_RADAR_RESPONSE:
-    case MIP_CMD_GET_GESTURE_RESPONSE:
-    case MIP_CMD_CLAP_RESPONSE:
-    case MIP_CMD_GET_WEIGHT:
-    case MIP_CMD_GET_DETECTED_MIP:
-        length = 1;
-        break;
-    case MIP_CMD_SHAKE_RESPONSE:
-        length = 0;
-        break;
-    case MIP_CMD_GET_STATUS:
-        length = 2;
-        break;
-    case MIP_CMD_RECEIVE_IR_DONGLE_CODE:
-        // MIP_CMD_RECEIVE_IR_DONGLE_CODE is the only message delivered by MiP that has a
-        // variable length so we need to read the next byte which contains the length.
-        uint8_t nibbles[2];
-        bytesRead = Serial.readBytes(nibbles, sizeof(nibbles));
-        if (bytesRead != sizeof(nibbles))
-        {
-            MiPStream.println(F("MiP: Missing IR code length"));
-            return;
-        }
-        length = (parseHexDigit(nibbles[0]) << 4) | parseHexDigit(nibbles[1]);
-        if (length < 2 || length > 4)
+        // Only keep the response if it is still the one being waited upon.
+        if (m_rxFrame[0] == m_expectedResponseCommand && m_rxFrameLength == m_expectedResponseSize)
         {
-            uint8_t discardedBytes = discardUnexpectedSerialData();
-            MiPStream.print(F("MiP: Bad IR code length: "));
-            MiPStream.print(length, HEX);
-            MiPStream.print(F(" (discarded "));
-            MiPStream.print(discardedBytes);
-            MiPStream.println(F(" bytes)"));
-            return;
+            memcpy(m_responseBuffer, m_rxFrame, m_rxFrameLength);
+            responseFound = true;
         }
-        break;
-    default:
-        uint8_t discardedBytes = discardUnexpectedSerialData();
-        MiPStream.print(F("MiP: Bad OOB command byte: "));
-            MiPStream.print(commandByte, HEX);
-            MiPStream.print(F(" (discarded "));
-            MiPStream.print(discardedBytes);
-            MiPStream.println(F(" bytes)"));
-        return;
     }
+    else if (!processOobResponseData(m_rxFrame, m_rxFrameLength))
+    {
+        // The notification's contents make no sense so it probably wasn't a real frame boundary after all.
+        resyncResponseDecoder();
+        return false;
+    }
+    traceRecord(MIP_TRACE_FLAG_FROM_MIP, m_rxFrame, m_rxFrameLength);
+
+    if (m_rxResyncSkippedBytes > 0)
+    {
+        mipLog(MIP_LOG_RESYNC_SKIPPED, m_rxResyncSkippedBytes);
+        m_rxResyncSkippedBytes = 0;
+    }
+    resetResponseDecoder();
 
-    // Read in the additional bytes of the notification.  The "4" comes from maximum length
-    // which is a response for MIP_CMD_RECEIVE_IR_DONGLE_CODE.
-    uint8_t buffer[4 * 2];
-    bytesRead = Serial.readBytes(buffer, length * 2);
+    return responseFound;
+}
+
+// This internal protected method converts hex text into binary. It returns false if any of the characters weren't
+// valid hex digits.
+bool MiP::copyHexTextToBinary(uint8_t* pDest, const uint8_t* pSrc, uint8_t length)
+{
+    // Accumulate the nibbles so that invalid digits only need to be checked for once at the end.
+    uint8_t allNibbles = 0;
 
-    if (bytesRead != length * 2)
+    while (length-- > 0)
     {
-        MiPStream.print(F("MiP: OOB too short: "));
-            MiPStream.print(bytesRead);
-            MiPStream.print(',');
-            MiPStream.println(length * 2);
-        return;
+        uint8_t highNibble = mipParseHexDigit(pSrc[0]);
+        uint8_t lowNibble = mipParseHexDigit(pSrc[1]);
+        allNibbles |= highNibble | lowNibble;
+        *pDest = (highNibble << 4) | lowNibble;
+        pDest++;
+        pSrc+=2;
     }
 
-    // Convert the hex data to a binary response.
-    uint8_t response[MIP_RESPONSE_MAX_LEN];
-    response[0] = commandByte;
-    copyHexTextToBinary(&response[1], buffer, length);
+    return allNibbles != MIP_INVALID_HEX_DIGIT;
+}
 
+// This internal protected method processes an out of band notification sent from the MiP. It returns false if the
+// contents of the notification aren't valid, which indicates that the decoder has lost sync with the MiP.
+bool MiP::processOobResponseData(const uint8_t* pFrame, uint8_t frameLength)
+{
     // Have 32 bits ready in case of an IR event.
     uint32_t irCode = 0;
+    // Queued events are stamped with the time that the frame was received, as recorded by the decoder.
+    uint16_t arrivalTime = m_rxFrameArrivalTime;
 
-    // Process the response just received.
-    switch (commandByte)
+    // Process the notification just received.
+    switch (pFrame[0])
     {
     case MIP_CMD_GET_RADAR_RESPONSE:
-        if (response[1] >= MIP_RADAR_NONE && response[1] <= MIP_RADAR_0CM_10CM)
+        if (pFrame[1] < MIP_RADAR_NONE || pFrame[1] > MIP_RADAR_0CM_10CM)
+        {
+            return false;
+        }
+        m_lastRadar = (MiPRadar)pFrame[1];
+        m_flags |= MIP_FLAG_RADAR_VALID;
+        if (m_callbacks.radar)
         {
-            m_lastRadar = (MiPRadar)response[1];
-            m_flags |= MIP_FLAG_RADAR_VALID;
+            m_callbacks.radar(m_lastRadar);
         }
         break;
     case MIP_CMD_GET_GESTURE_RESPONSE:
-        if (response[1] >= MIP_GESTURE_LEFT && response[1] <= MIP_GESTURE_BACKWARD)
+        if (pFrame[1] < MIP_GESTURE_LEFT || pFrame[1] > MIP_GESTURE_BACKWARD)
+        {
+            return false;
+        }
+        if (m_callbacks.gesture)
+        {
+            m_callbacks.gesture((MiPGesture)pFrame[1]);
+        }
+        else
         {
-            m_gestureEvents.push((MiPGesture)response[1]);
+            m_gestureEvents.push({ (MiPGesture)pFrame[1], arrivalTime });
         }
         break;
     case MIP_CMD_SHAKE_RESPONSE:
-        m_flags |= MIP_FLAG_SHAKE_DETECTED;
+        if (m_callbacks.shake)
+        {
+            m_callbacks.shake();
+        }
+        else
+        {
+            m_flags |= MIP_FLAG_SHAKE_DETECTED;
+        }
         break;
     case MIP_CMD_GET_STATUS:
-        parseStatus(m_lastStatus, response, length + 1);
+        if (!processStatusNotification(pFrame, frameLength))
+        {
+            return false;
+        }
         break;
     case MIP_CMD_GET_WEIGHT:
-        m_lastWeight = response[1];
+        m_lastWeight = pFrame[1];
         m_flags |= MIP_FLAG_WEIGHT_VALID;
         break;
     case MIP_CMD_CLAP_RESPONSE:
-        m_clapEvents.push(response[1]);
+        if (m_callbacks.clap)
+        {
+            m_callbacks.clap(pFrame[1]);
+        }
+        else
+        {
+            m_clapEvents.push({ pFrame[1], arrivalTime });
+        }
         break;
     case MIP_CMD_GET_DETECTED_MIP:
-        m_detectedMiPEvents.push(response[1]);
+        if (m_callbacks.detectedMiP)
+        {
+            m_callbacks.detectedMiP(pFrame[1]);
+        }
+        else
+        {
+            m_detectedMiPEvents.push({ pFrame[1], arrivalTime });
+        }
         break;
     case MIP_CMD_RECEIVE_IR_DONGLE_CODE:
-        for(size_t i = 0; i < length; i++)
+        // Skip over the length byte to get to the actual IR code bytes.
+        for (uint8_t i = 2 ; i < frameLength ; i++)
         {
             irCode <<= 8;
-            irCode |= response[i+1];
+            irCode |= pFrame[i];
+        }
+        if (m_callbacks.irCode)
+        {
+            m_callbacks.irCode(irCode);
+        }
+        else
+        {
+            m_irCodeEvents.push({ irCode, arrivalTime });
         }
-        m_irCodeEvents.push(irCode);
         break;
     default:
-        // Invalid notification command bytes were already handled in the previous switch so should never get here.
+        // Invalid notification command bytes were already rejected by processResponseByte() so should never get here.
         MIP_ASSERT ( false );
         break;
     }
+    statsRecordOob(pFrame[0]);
+    return true;
+}
+
+// This internal protected method records the status sent by the MiP in a periodic notification and lets the status
+// callback know if it has changed. It returns false if the status isn't valid.
+bool MiP::processStatusNotification(const uint8_t* pFrame, uint8_t frameLength)
+{
+    MiPStatus status;
+    if (parseStatus(status, pFrame, frameLength) != MIP_ERROR_NONE)
+    {
+        return false;
+    }
+
+    bool hasChanged = status.battery != m_lastStatus.battery || status.position != m_lastStatus.position;
+    m_lastStatus = status;
+    if (hasChanged && m_callbacks.statusChange)
+    {
+        m_callbacks.statusChange(m_lastStatus);
+    }
+    return true;
+}
+
+bool MiP::isResponseFrameInProgress()
+{
+    return m_rxFrameLength > 0 || m_rxHighDigit != 0;
+}
+
+// This internal protected method is called when the frame being decoded turns out to be implausible. Rather than
+// throwing away everything received so far, it skips just the first digit of the frame and queues up the rest to be
+// decoded again. Repeating this slides the decoder forward one digit at a time until it lands on a real frame boundary.
+void MiP::resyncResponseDecoder()
+{
+    uint8_t digits[sizeof(m_rxReplay) + 1];
+    uint8_t count = 0;
+
+    for (uint8_t i = 0 ; i < m_rxFrameLength ; i++)
+    {
+        digits[count++] = pgm_read_byte(&g_hexDigitChars[m_rxFrame[i] >> 4]);
+        digits[count++] = pgm_read_byte(&g_hexDigitChars[m_rxFrame[i] & 0xF]);
+    }
+    if (m_rxHighDigit != 0)
+    {
+        digits[count++] = m_rxHighDigit;
+    }
+    // Digits already queued up from an earlier resync still need to be decoded after these ones.
+    while (m_rxReplayIndex < m_rxReplayLength)
+    {
+        digits[count++] = m_rxReplay[m_rxReplayIndex++];
+    }
+    MIP_ASSERT ( count > 0 && count <= sizeof(digits) );
+
+    memcpy(m_rxReplay, &digits[1], count - 1);
+    m_rxReplayIndex = 0;
+    m_rxReplayLength = count - 1;
+    skipResponseDigits(1);
+    resetResponseDecoder();
+}
+
+// This internal protected method keeps count of the received digits which weren't part of any valid frame.
+void MiP::skipResponseDigits(uint8_t count)
+{
+    m_rxSkippedBytes += count;
+    if (m_rxResyncSkippedBytes <= 255 - count)
+    {
+        m_rxResyncSkippedBytes += count;
+    }
+}
+
+void MiP::resetResponseDecoder()
+{
+    m_rxFrameLength = 0;
+    m_rxFrameSize = 0;
+    m_rxHighDigit = 0;
+    m_rxFlags = 0;
 }
 
 uint8_t MiP::discardUnexpectedSerialData()
 {
     uint8_t discardedBytes = 0;
 
+    // Any partially decoded frame is being thrown away as well.
+    resetResponseDecoder();
+    m_rxReplayIndex = 0;
+    m_rxReplayLength = 0;
+    m_rxResyncSkippedBytes = 0;
+
     // Unexpected response data encountered. Throw away all data in serial buffer since it is hard to tell
     // where next response begins.
-    while (Serial.available() > 0)
+    while (m_pTransport->available() > 0)
     {
         discardedBytes++;
-        Serial.read();
+        m_pTransport->read();
         // Delay long enough for next serial byte to be received if MiP is still actively sending at 115200 baud.
         delayMicroseconds(100);
     }
+    uint8_t  frameLength;
+    uint16_t arrivalTime;
+    while ((frameLength = m_pTransport->readFrame(m_rxFrame, sizeof(m_rxFrame), arrivalTime)) > 0)
+    {
+        discardedBytes += frameLength;
+    }
     return discardedBytes;
 }
 
 
 
+// MiPTransport which talks to the MiP over a HardwareSerial port, optionally shared with the PC via a TS3USB221A.
+MiPSerialTransport::MiPSerialTransport(HardwareSerial& serial, int8_t selectPin /* = -1 */)
+{
+    m_pSerial = &serial;
+    m_baudRate = MIP_BAUD_RATE;
+    m_selectPin = selectPin;
+}
+
+void MiPSerialTransport::begin()
+{
+    if (m_selectPin < 0)
+    {
+        return;
+    }
+
+    // Configure the pin used to select the UART destination between the MiP and PC. Start out connected to the PC.
+    pinMode(m_selectPin, OUTPUT);
+    digitalWrite(m_selectPin, LOW);
+}
+
+void MiPSerialTransport::end()
+{
+    if (m_selectPin < 0)
+    {
+        // The port isn't shared with MiPStream so it is up to this transport to shut it down.
+        m_pSerial->end();
+        return;
+    }
+
+    pinMode(m_selectPin, INPUT);
+}
+
+void MiPSerialTransport::setBaudRate(uint32_t baudRate)
+{
+    m_baudRate = baudRate;
+    m_pSerial->begin(baudRate);
+}
+
+int MiPSerialTransport::available()
+{
+    return m_pSerial->available();
+}
+
+int MiPSerialTransport::read()
+{
+    return m_pSerial->read();
+}
+
+size_t MiPSerialTransport::write(uint8_t byte)
+{
+    return m_pSerial->write(byte);
+}
+
+void MiPSerialTransport::flush()
+{
+    m_pSerial->flush();
+}
+
+void MiPSerialTransport::selectMiP()
+{
+    if (m_selectPin < 0 || isMiPSelected())
+    {
+        return;
+    }
+
+    m_pSerial->flush();
+    if (m_baudRate != MIP_BAUD_RATE)
+    {
+        m_pSerial->begin(m_baudRate);
+    }
+    digitalWrite(m_selectPin, HIGH);
+}
+
+void MiPSerialTransport::selectPC()
+{
+    if (m_selectPin < 0 || !isMiPSelected())
+    {
+        return;
+    }
+
+    m_pSerial->flush();
+    if (m_baudRate != MIP_BAUD_RATE)
+    {
+        // The PC always communicates at 115200 baud.
+        m_pSerial->begin(MIP_BAUD_RATE);
+    }
+    digitalWrite(m_selectPin, LOW);
+}
+
+bool MiPSerialTransport::isMiPSelected()
+{
+    if (m_selectPin < 0)
+    {
+        // Port isn't shared with the PC.
+        return false;
+    }
+    return digitalRead(m_selectPin) == HIGH;
+}
+
+
+
 // This class can be used instead of Serial for sending text to the PC. It makes sure that the MiP ProMini Pack switches
 // the UART signals away from the MiP and to the PC before actually performing the Serial write.
 MiPStream::MiPStream()
 {
+#if MIP_STREAM_BUFFER_SIZE > 0
+    m_bufferLength = 0;
+#endif
+    m_muxSwitchCount = 0;
+    m_sendEachLine = true;
     m_isInit = false;
 }
 
@@ -2541,58 +4406,122 @@ MiPStream::MiPStream()
 int MiPStream::available()
 {
     initIfNeeded();
-    return Serial.available();
+    return MIP_SERIAL.available();
 }
 
 int MiPStream::read()
 {
     initIfNeeded();
-    return Serial.read();
+    return MIP_SERIAL.read();
 }
 
 int MiPStream::peek()
 {
     initIfNeeded();
-    return Serial.peek();
+    return MIP_SERIAL.peek();
 }
 
 // Methods that must be implemented for Print subclasses.
 size_t MiPStream::write(uint8_t byte)
 {
-    initIfNeeded();
-    bool needToRestore = MiP::isInstanceSerialGoingToMiP();
-    MiP::switchInstanceSerialToPC();
-    size_t result = Serial.write(byte);
-    if (needToRestore)
-    {
-        MiP::switchInstanceSerialToMiP();
-    }
-    return result;
+    return write(&byte, 1);
 }
 
 size_t MiPStream::write(const uint8_t *pBuffer, size_t size)
 {
     initIfNeeded();
-    bool needToRestore = MiP::isInstanceSerialGoingToMiP();
-    MiP::switchInstanceSerialToPC();
-    size_t result = Serial.write(pBuffer, size);
-    if (needToRestore)
+#if MIP_STREAM_BUFFER_SIZE > 0
+    if (!MiP::isInstanceSerialGoingToMiP())
     {
-        MiP::switchInstanceSerialToMiP();
+        // The UART is already connected to the PC so there is nothing to be saved by buffering.
+        sendBufferedOutput();
+        return writeToPC(pBuffer, size);
     }
-    return result;
+
+    for (size_t i = 0 ; i < size ; i++)
+    {
+        if (m_bufferLength == sizeof(m_buffer))
+        {
+            sendBufferedOutput();
+        }
+        m_buffer[m_bufferLength++] = pBuffer[i];
+        if (m_sendEachLine && pBuffer[i] == '\n')
+        {
+            // Send each complete line so that output still shows up promptly in sketches which never call update().
+            sendBufferedOutput();
+        }
+    }
+    return size;
+#else
+    return writeToPC(pBuffer, size);
+#endif // MIP_STREAM_BUFFER_SIZE > 0
 }
 
 int MiPStream::availableForWrite()
 {
     initIfNeeded();
-    return Serial.availableForWrite();
+#if MIP_STREAM_BUFFER_SIZE > 0
+    return sizeof(m_buffer) - m_bufferLength;
+#else
+    return MIP_SERIAL.availableForWrite();
+#endif
 }
 
 void MiPStream::flush()
 {
     initIfNeeded();
-    return Serial.flush();
+    sendBufferedOutput();
+    return MIP_SERIAL.flush();
+}
+
+void MiPStream::sendBufferedOutput(uint8_t maxLength /* = 0xFF */)
+{
+#if MIP_STREAM_BUFFER_SIZE > 0
+    if (m_bufferLength == 0 || maxLength == 0)
+    {
+        return;
+    }
+    if (maxLength >= m_bufferLength)
+    {
+        // Clear the buffer before writing it out in case the MiP object has something to say while switching the UART.
+        uint8_t length = m_bufferLength;
+        m_bufferLength = 0;
+        writeToPC(m_buffer, length);
+        return;
+    }
+
+    writeToPC(m_buffer, maxLength);
+    m_bufferLength -= maxLength;
+    memmove(m_buffer, m_buffer + maxLength, m_bufferLength);
+#else
+    // Silence compiler warnings about unused parameters.
+    (void)maxLength;
+#endif // MIP_STREAM_BUFFER_SIZE > 0
+}
+
+uint8_t MiPStream::bufferedOutputLength()
+{
+#if MIP_STREAM_BUFFER_SIZE > 0
+    return m_bufferLength;
+#else
+    return 0;
+#endif
+}
+
+size_t MiPStream::writeToPC(const uint8_t* pBuffer, size_t size)
+{
+    bool needToRestore = MiP::isInstanceSerialGoingToMiP();
+    if (needToRestore)
+    {
+        m_muxSwitchCount++;
+    }
+    MiP::switchInstanceSerialToPC();
+    size_t result = MIP_SERIAL.write(pBuffer, size);
+    if (needToRestore)
+    {
+        MiP::switchInstanceSerialToMiP();
+    }
+    return result;
 }
 
 void MiPStream::begin(unsigned long baud, uint8_t mode)
@@ -2609,7 +4538,7 @@ void MiPStream::begin(unsigned long baud, uint8_t mode)
     m_isInit = true;
 
     // Fix the baud rate / mode at 115200-8-N-1 since that is required by the MiP.
-    Serial.begin(MIP_BAUD_RATE, SERIAL_8N1);
+    MIP_SERIAL.begin(MIP_BAUD_RATE, SERIAL_8N1);
 }
 
 void MiPStream::end()
@@ -2620,7 +4549,8 @@ void MiPStream::end()
         return;
     }
 
-    Serial.end();
+    flush();
+    MIP_SERIAL.end();
     m_isInit = false;
 }
 
@@ -40,6 +40,123 @@
 #define MIP_REQUEST_MAX_LEN     (17 + 1)    // Longest request is MIP_CMD_PLAY_SOUND.
 #define MIP_RESPONSE_MAX_LEN    (5 + 1)     // Longest response is MIP_CMD_REQUEST_CHEST_LED.
 
+// Number of requests that can be queued up for sending to the MiP when async requests are enabled. A request made while
+// the queue is full blocks until the oldest queued request has been sent.
+#ifndef MIP_REQUEST_QUEUE_SIZE
+    #define MIP_REQUEST_QUEUE_SIZE  4
+#endif
+
+// Number of notifications of each type that can be queued up between calls to read them (readClapEvent(),
+// readGestureEvent(), etc). setEventOverflowPolicy() selects what happens once a queue is full. These can be overridden
+// when building the library, with powers of 2 being the cheapest. A size of 0 removes the queue and its notifications
+// are then only delivered to callbacks.
+#ifndef MIP_CLAP_QUEUE_SIZE
+    #define MIP_CLAP_QUEUE_SIZE         8
+#endif
+#ifndef MIP_GESTURE_QUEUE_SIZE
+    #define MIP_GESTURE_QUEUE_SIZE      8
+#endif
+#ifndef MIP_IR_CODE_QUEUE_SIZE
+    #define MIP_IR_CODE_QUEUE_SIZE      8
+#endif
+#ifndef MIP_DETECTED_MIP_QUEUE_SIZE
+    #define MIP_DETECTED_MIP_QUEUE_SIZE 8
+#endif
+
+// Number of sounds that can wait in the queue behind the one being played by queueSound(). Must be at least 1.
+#ifndef MIP_SOUND_QUEUE_SIZE
+    #define MIP_SOUND_QUEUE_SIZE        4
+#endif
+
+// begin() remembers the baud rate of the last MiP that it connected to in the AVR's own EEPROM so that it can try that
+// baud rate first next time. It uses MIP_CONNECTION_EEPROM_SIZE bytes starting at MIP_CONNECTION_EEPROM_ADDRESS, at the
+// very end of EEPROM by default. Define MIP_PERSIST_CONNECTION to 0 if the sketch needs that part of the EEPROM for
+// something else.
+#ifndef MIP_PERSIST_CONNECTION
+    #if defined(__AVR__) && defined(E2END)
+        #define MIP_PERSIST_CONNECTION 1
+    #else
+        #define MIP_PERSIST_CONNECTION 0
+    #endif
+#endif
+#define MIP_CONNECTION_EEPROM_SIZE 8
+#ifndef MIP_CONNECTION_EEPROM_ADDRESS
+    #define MIP_CONNECTION_EEPROM_ADDRESS (E2END + 1 - MIP_CONNECTION_EEPROM_SIZE)
+#endif
+
+// Define MIP_USE_SIMULATOR to 1 when building the library to have MiP objects created with the default constructor talk
+// to the simulated MiP returned by mipDefaultSimulator() (see mip_simulator.h) instead of a real MiP robot. This allows
+// unmodified sketches to be run and measured without a robot.
+#ifndef MIP_USE_SIMULATOR
+    #define MIP_USE_SIMULATOR 0
+#endif
+
+// Define MIP_ENABLE_STATS to 1 when building the library to have the MiP class keep protocol statistics for each
+// command that it sends, which can be read with snapshotStats(). They use about 450 bytes of RAM so are left out by
+// default.
+#ifndef MIP_ENABLE_STATS
+    #define MIP_ENABLE_STATS 0
+#endif
+// Number of slots in the latency histogram kept for each command. Slot 0 counts responses which arrived within
+// (1 << MIP_STATS_LATENCY_SHIFT) microseconds of the request being sent and each slot after that covers twice as long
+// as the one before it. The last slot counts all of the slower responses.
+#define MIP_STATS_LATENCY_BUCKETS   8
+#define MIP_STATS_LATENCY_SHIFT     10
+// Number of different commands that the library sends to the MiP and how many of those the MiP responds to.
+#define MIP_STATS_REQUEST_SLOTS     38
+#define MIP_STATS_RESPONSE_SLOTS    13
+
+// Define MIP_TRACE_SIZE to the number of bytes of RAM to set aside for a trace of the most recent requests sent to the
+// MiP and frames received back from it, which can be sent to the PC with dumpTrace(). Each request or frame takes
+// MIP_TRACE_RECORD_HEADER_SIZE bytes plus its own length. The trace is left out when this is 0, the default.
+#ifndef MIP_TRACE_SIZE
+    #define MIP_TRACE_SIZE 0
+#endif
+// Each trace record starts with a byte holding the MIP_TRACE_FLAG_* flags and the length of the request or frame,
+// followed by its micros() timestamp (little endian) and then the request or frame itself.
+#define MIP_TRACE_RECORD_HEADER_SIZE    5
+#define MIP_TRACE_FLAG_FROM_MIP         0x80    // Frame received from the MiP rather than a request sent to it.
+#define MIP_TRACE_LENGTH_MASK           0x1F
+// Version of the binary format sent by dumpTrace(). Bump it if the format changes.
+#define MIP_TRACE_FORMAT_VERSION        1
+
+// Define MIP_USE_ISR_RECEIVE to 1 when building the library to replace Serial with IsrSerial, a driver for the AVR's
+// USART which has its own receive interrupt handler. While the UART is switched to the MiP, the handler decodes the
+// MiP's hex text into binary frames as it arrives so that notifications aren't lost when the sketch is too busy to
+// drain the receive buffer. The Arduino core's Serial object has a receive interrupt handler of its own so it can't
+// be used by any code in the sketch once this is enabled. Sketches which write to Serial after including mip.h are
+// already redirected to MiPStream, which uses IsrSerial instead.
+#ifndef MIP_USE_ISR_RECEIVE
+    #define MIP_USE_ISR_RECEIVE 0
+#endif
+#if MIP_USE_ISR_RECEIVE && !defined(__AVR__)
+    #error "MIP_USE_ISR_RECEIVE is only supported on AVR based boards."
+#endif
+// Number of decoded MiP frames that IsrSerial can queue up. Must be a power of 2. Each frame takes
+// MIP_RESPONSE_MAX_LEN + 1 bytes, about half of what the hex text of the longest response would take in a regular
+// receive buffer.
+#ifndef MIP_ISR_FRAME_QUEUE_SIZE
+    #define MIP_ISR_FRAME_QUEUE_SIZE    4
+#endif
+// Number of characters received from the PC that IsrSerial can buffer. Must be a power of 2.
+#ifndef MIP_ISR_PC_BUFFER_SIZE
+    #define MIP_ISR_PC_BUFFER_SIZE      16
+#endif
+
+// Number of bytes written to MiPStream (and therefore Serial) that are held in RAM so that they can be sent to the PC
+// with a single switch of the UART away from the MiP. The buffer is sent when it fills up, at the end of each line, on
+// flush() and from MiP::update() while the MiP isn't in the middle of sending anything. Set it to 0 to switch the UART
+// for every write instead. Must be less than 256.
+#ifndef MIP_STREAM_BUFFER_SIZE
+    #define MIP_STREAM_BUFFER_SIZE 32
+#endif
+
+// Default retry policy used by MiP methods other than begin().
+#define MIP_DEFAULT_RETRY_ATTEMPTS  2   // Total number of attempts, including the first.
+#define MIP_DEFAULT_RETRY_DELAY     50  // Milliseconds to wait before the first retry.
+#define MIP_DEFAULT_RETRY_BACKOFF   2   // Each later retry waits this many times longer than the one before it.
+#define MIP_DEFAULT_MAX_RETRY_DELAY 400 // Longest wait between retries in milliseconds.
+
 enum MiPGestureRadarMode
 {
     MIP_GESTURE_RADAR_DISABLED = 0x00,
@@ -242,6 +359,41 @@ enum MiPVolume
     MIP_VOLUME_DEFAULT = 0xFF
 };
 
+// Longest delay, in milliseconds, that can follow a sound in a sound list or sequence.
+#define MIP_SOUND_MAX_DELAY (255 * 30)
+
+// One entry of a sound sequence played by MiP::playSoundSequence(). Each entry is either a sound followed by an optional
+// delay in milliseconds or a change of volume. Sequences must be declared with MIP_SOUND_SEQUENCE() so that they are
+// encoded at compile time and don't take up any RAM:
+//   MIP_SOUND_SEQUENCE(g_greeting, { MIP_VOLUME_4 }, { MIP_SOUND_MIP_HI_CONFIDENT, 300 });
+// Delays are rounded down to the MiP's 30 millisecond units. A delay longer than MIP_SOUND_MAX_DELAY or a volume other
+// than MIP_VOLUME_OFF - MIP_VOLUME_7 fails to compile in such an array.
+class MiPSoundEntry
+{
+public:
+    constexpr MiPSoundEntry(MiPSoundIndex soundIndex, uint16_t delayMillis = 0)
+        : sound(soundIndex), delay(delayMillis <= MIP_SOUND_MAX_DELAY ? delayMillis / 30 : delayTooLong())
+    {
+    }
+    constexpr MiPSoundEntry(MiPVolume volume)
+        : sound(volume <= MIP_VOLUME_7 ? MIP_SOUND_VOLUME_OFF + volume : volumeOutOfRange()), delay(0)
+    {
+    }
+
+    uint8_t sound;
+    uint8_t delay;
+
+protected:
+    // These aren't constexpr so that calling them stops an entry from being built at compile time.
+    static uint8_t delayTooLong() { return 255; }
+    static uint8_t volumeOutOfRange() { return MIP_SOUND_VOLUME_7; }
+};
+
+// Declares an array of MiPSoundEntry objects, called NAME, in PROGMEM. The array is constexpr so that every entry must
+// be built at compile time. A PROGMEM array which isn't constant initialized would be filled in at startup through a
+// RAM address that doesn't belong to it, leaving playSoundSequence() to play whatever is in program memory.
+#define MIP_SOUND_SEQUENCE(NAME, ...) static constexpr MiPSoundEntry NAME[] PROGMEM = { __VA_ARGS__ }
+
 enum MiPClapEnabled
 {
     MIP_CLAP_DISABLED = 0x00,
@@ -260,6 +412,13 @@ enum MiPGameMode
     MIP_ROAM_MODE     = 0x08
 };
 
+// What happens to notifications which arrive while their queue is already full. See MiP::setEventOverflowPolicy().
+enum MiPEventOverflowPolicy
+{
+    MIP_EVENT_OVERWRITE_OLDEST = QUEUE_OVERWRITE_OLDEST,
+    MIP_EVENT_DROP_NEWEST      = QUEUE_DROP_NEWEST
+};
+
 
 
 class MiPStatus
@@ -384,6 +543,277 @@ public:
     uint16_t       delay;
 };
 
+class MiPRetryPolicy
+{
+public:
+    MiPRetryPolicy()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        retryDelay = MIP_DEFAULT_RETRY_DELAY;
+        maxRetryDelay = MIP_DEFAULT_MAX_RETRY_DELAY;
+        deadline = 0;
+        maxAttempts = MIP_DEFAULT_RETRY_ATTEMPTS;
+        backoffFactor = MIP_DEFAULT_RETRY_BACKOFF;
+        adaptive = true;
+    }
+
+    uint16_t retryDelay;    // Milliseconds to wait before the first retry.
+    uint16_t maxRetryDelay; // Longest wait between retries in milliseconds.
+    uint16_t deadline;      // Give up once this many milliseconds have passed since the first attempt. 0 for no limit.
+    uint8_t  maxAttempts;   // Total number of attempts, including the first.
+    uint8_t  backoffFactor; // Each later retry waits this many times longer than the one before it.
+    bool     adaptive;      // Retry right away while the link is healthy and wait longer while it is flaky.
+};
+
+// Functions which can be registered with MiP::onGesture() and friends to be called as soon as each type of notification
+// is received from the MiP.
+typedef void (*MiPGestureCallback)(MiPGesture gesture);
+typedef void (*MiPRadarCallback)(MiPRadar radar);
+typedef void (*MiPClapCallback)(uint8_t clapCount);
+typedef void (*MiPShakeCallback)();
+typedef void (*MiPStatusCallback)(const MiPStatus& status);
+typedef void (*MiPIRCodeCallback)(uint32_t code);
+typedef void (*MiPDetectedCallback)(uint8_t id);
+
+// Function which can be registered with MiP::onSoundFinished() to be called as the queue moves on from each sound passed
+// to MiP::queueSound(). The MiP doesn't report when a sound ends so this happens once the sound's estimated duration has
+// elapsed, which can be well before or after the robot actually stops playing it. interrupted is true if it was cut
+// short by another sound or clearSoundQueue(), or if it was dropped from the queue without being played.
+typedef void (*MiPSoundFinishedCallback)(MiPSoundIndex sound, bool interrupted);
+
+#if MIP_ENABLE_STATS
+// Types of out of band notification counted in MiPStats::oobFrames.
+enum MiPOobType
+{
+    MIP_OOB_STATUS = 0,
+    MIP_OOB_WEIGHT,
+    MIP_OOB_RADAR,
+    MIP_OOB_GESTURE,
+    MIP_OOB_CLAP,
+    MIP_OOB_SHAKE,
+    MIP_OOB_DETECTED_MIP,
+    MIP_OOB_IR_CODE,
+    MIP_OOB_TYPE_COUNT
+};
+
+// Statistics kept for each command which the MiP responds to. Latencies are measured from when the request finished
+// being sent until the whole response has been received.
+class MiPCommandStats
+{
+public:
+    uint16_t responses;     // Responses received.
+    uint16_t timeouts;      // Requests which didn't get a response within the timeout.
+    uint16_t badResponses;  // Responses which were received but didn't contain valid data.
+    uint16_t retries;       // Calls which were retried after this request failed.
+    uint32_t maxLatency;    // Slowest response in microseconds.
+    uint16_t latency[MIP_STATS_LATENCY_BUCKETS];  // Log2 histogram of response latencies (see MIP_STATS_LATENCY_SHIFT).
+};
+
+// Protocol statistics returned by MiP::snapshotStats(). The counters are 16-bit so they wrap around if too much time
+// passes between calls to MiP::resetStats().
+class MiPStats
+{
+public:
+    MiPStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    // Number of times that the specified MIP_CMD_* command byte (see mip_protocol.h) was sent to the MiP.
+    uint16_t sentCount(uint8_t command) const;
+    // Response statistics for the specified command byte or NULL if the MiP doesn't respond to that command.
+    const MiPCommandStats* responseStats(uint8_t command) const;
+
+    // The arrays below are indexed by slot rather than command byte to save RAM. slotCommand() returns the command
+    // byte counted in each slot. The first MIP_STATS_RESPONSE_SLOTS slots are used by the commands with responses so
+    // the same slot indexes both sent[] and responses[].
+    static uint8_t slotCommand(uint8_t slot);
+
+    uint16_t        sent[MIP_STATS_REQUEST_SLOTS];
+    MiPCommandStats responses[MIP_STATS_RESPONSE_SLOTS];
+    uint16_t        oobFrames[MIP_OOB_TYPE_COUNT];
+};
+#endif // MIP_ENABLE_STATS
+
+
+
+// Interface used by the MiP class to exchange bytes with the MiP robot. By default the MiP class uses a
+// MiPSerialTransport for the UART and TS3USB221A switch found on the MiP ProMini Pack. Derive from this class and pass
+// an instance of it to the MiP constructor to talk to the MiP some other way, such as over SoftwareSerial or to a mock
+// MiP when running the library on a desktop machine.
+class MiPTransport
+{
+public:
+    virtual ~MiPTransport() {}
+
+    // Called from MiP::begin() and MiP::end() to claim and release the hardware used to talk to the MiP.
+    virtual void   begin() = 0;
+    virtual void   end() = 0;
+    // Called from MiP::begin() as it tries each of the baud rates used by MiP robots.
+    virtual void   setBaudRate(uint32_t baudRate) = 0;
+
+    // These work just like their Stream counterparts.
+    virtual int    available() = 0;
+    virtual int    read() = 0;
+    virtual size_t write(uint8_t byte) = 0;
+    virtual void   flush() = 0;
+
+    // Transports which share their port with the PC, like the one on the MiP ProMini Pack, override these to switch
+    // the port between the two. MiPStream calls them so that text written to Serial makes it to the PC.
+    virtual void   selectMiP() {}
+    virtual void   selectPC() {}
+    virtual bool   isMiPSelected() { return false; }
+
+    // Transports which decode the MiP's hex text into binary frames themselves, like MiPIsrTransport, override these to
+    // return true and hand each complete frame over through readFrame() instead of read(). readFrame() returns the
+    // length of the frame copied into pFrame or 0 if no frames are waiting. arrivalTime is set to the lower 16 bits of
+    // millis() when the frame was received.
+    virtual bool    decodesFrames() { return false; }
+    virtual uint8_t readFrame(uint8_t* pFrame, uint8_t frameSize, uint16_t& arrivalTime)
+    {
+        (void)pFrame;
+        (void)frameSize;
+        (void)arrivalTime;
+        return 0;
+    }
+};
+
+// MiPTransport which talks to the MiP over a HardwareSerial port. If selectPin isn't negative then it also drives the
+// TS3USB221A switch connected to that pin so that the port can be shared with the PC, like on the MiP ProMini Pack.
+//   MiPSerialTransport transport(Serial1);
+//   MiP                mip(transport);
+class MiPSerialTransport : public MiPTransport
+{
+public:
+    MiPSerialTransport(HardwareSerial& serial, int8_t selectPin = -1);
+
+    virtual void   begin();
+    virtual void   end();
+    virtual void   setBaudRate(uint32_t baudRate);
+
+    virtual int    available();
+    virtual int    read();
+    virtual size_t write(uint8_t byte);
+    virtual void   flush();
+
+    virtual void   selectMiP();
+    virtual void   selectPC();
+    virtual bool   isMiPSelected();
+
+protected:
+    HardwareSerial* m_pSerial;
+    uint32_t        m_baudRate;
+    int8_t          m_selectPin;
+};
+
+#if MIP_USE_ISR_RECEIVE
+// Interrupt driven driver for the AVR's USART, used in place of Serial when the library is built with
+// MIP_USE_ISR_RECEIVE set to 1. It has the same interface as Serial for talking to the PC. Once frame decoding is
+// enabled, its receive interrupt handler decodes the hex text sent by the MiP into binary frames which are read with
+// readFrame(). Bytes are transmitted without interrupts, as soon as the USART is ready for each one.
+class MiPIsrSerial : public Stream
+{
+public:
+    MiPIsrSerial();
+
+    void begin(unsigned long baud) { begin(baud, SERIAL_8N1); }
+    void begin(unsigned long baud, uint8_t config);
+    void end();
+
+    // Methods that must be implemented for Stream subclasses. They only see characters received from the PC.
+    virtual int    available();
+    virtual int    read();
+    virtual int    peek();
+
+    // Methods that must be implemented for Print subclasses.
+    virtual size_t write(uint8_t byte);
+    virtual int    availableForWrite();
+    virtual void   flush();
+    using Print::write;
+
+    // Frames received while decoding is enabled are queued up for readFrame(), which returns the length of the frame
+    // or 0 if none are waiting. pFrame must have room for MIP_RESPONSE_MAX_LEN bytes. arrivalTime is set to the lower
+    // 16 bits of millis() when the interrupt handler received the last digit of the frame.
+    void     enableFrameDecoding();
+    void     disableFrameDecoding();
+    uint8_t  readFrame(uint8_t* pFrame, uint8_t frameSize, uint16_t& arrivalTime);
+    // Number of frames which were thrown away because the frame queue was full and number of received characters
+    // which weren't part of a valid frame.
+    uint16_t droppedFrameCount();
+    uint16_t skippedDigitCount();
+
+    // Called from the receive interrupt handler with each character received.
+    void     receiveByte(uint8_t byte);
+
+protected:
+    void     decodeDigit(uint8_t digit);
+    void     queueFrame();
+    void     resetFrameDecoder();
+
+    // Decoded frames waiting in m_frameQueue to be read.
+    struct Frame
+    {
+        uint16_t arrivalTime;
+        uint8_t  length;
+        uint8_t  data[MIP_RESPONSE_MAX_LEN];
+    };
+
+    SpscQueue<uint8_t, MIP_ISR_PC_BUFFER_SIZE> m_pcBuffer;
+    SpscQueue<Frame, MIP_ISR_FRAME_QUEUE_SIZE> m_frameQueue;
+    Frame             m_frame;
+    volatile uint16_t m_droppedFrames;
+    volatile uint16_t m_skippedDigits;
+    volatile bool     m_isDecodingFrames;
+    uint8_t           m_frameLength;
+    uint8_t           m_frameSize;
+    uint8_t           m_highDigit;
+    uint8_t           m_lastDigitTime;
+    bool              m_isVariableLength;
+    bool              m_hasWritten;
+};
+
+extern MiPIsrSerial IsrSerial;
+
+// MiPTransport used by the MiP class in place of MiPSerialTransport when the library is built with MIP_USE_ISR_RECEIVE
+// set to 1. It works the same way but enables frame decoding in IsrSerial while the UART is switched to the MiP.
+class MiPIsrTransport : public MiPTransport
+{
+public:
+    MiPIsrTransport(MiPIsrSerial& serial, int8_t selectPin = -1);
+
+    virtual void    begin();
+    virtual void    end();
+    virtual void    setBaudRate(uint32_t baudRate);
+
+    // The MiP's data is only handed over as decoded frames so available() and read() never return any.
+    virtual int     available();
+    virtual int     read();
+    virtual size_t  write(uint8_t byte);
+    virtual void    flush();
+
+    virtual void    selectMiP();
+    virtual void    selectPC();
+    virtual bool    isMiPSelected();
+
+    virtual bool    decodesFrames() { return true; }
+    virtual uint8_t readFrame(uint8_t* pFrame, uint8_t frameSize, uint16_t& arrivalTime);
+
+protected:
+    MiPIsrSerial* m_pSerial;
+    uint32_t      m_baudRate;
+    int8_t        m_selectPin;
+};
+#endif // MIP_USE_ISR_RECEIVE
+
 
 
 class MiP
@@ -391,6 +821,7 @@ class MiP
 public:
     // Constructor/Destructors.
     MiP(int8_t serialSelectPin = MIP_UART_SELECT_PIN);
+    MiP(MiPTransport& transport);
     ~MiP();
 
     bool begin();
@@ -417,6 +848,122 @@ public:
     }
     void printLastCallResult();
 
+    // Failed requests are retried as dictated by the retry policy. setRetryPolicy() changes the policy used by all
+    // future calls while overrideRetryPolicyForNextCall() only applies to the next call which needs to retry a request.
+    void setRetryPolicy(const MiPRetryPolicy& policy);
+    void getRetryPolicy(MiPRetryPolicy& policy);
+    void overrideRetryPolicyForNextCall(const MiPRetryPolicy& policy);
+    // Recent success rate of requests sent to the MiP, from 0 (all failing) to 255 (all succeeding).
+    uint8_t linkHealth()
+    {
+        return m_linkHealth;
+    }
+    // Number of times that a failed call has been retried since the last clear.
+    uint16_t retryCount()
+    {
+        return m_retryCount;
+    }
+    void clearRetryCount()
+    {
+        m_retryCount = 0;
+    }
+
+    // The library leaves a gap between requests so that the MiP doesn't ignore them. It is never less than 8 ms and is
+    // raised above that for MiPs which are slow to respond. requestDelay() returns the current gap in microseconds,
+    // responseLatency() returns the measured average time that the MiP takes to start responding to a request, also in
+    // microseconds, and pinRequestDelay() can be used to fix the gap at a specific value after begin() has been called.
+    uint16_t requestDelay()
+    {
+        return m_requestDelay;
+    }
+    uint16_t responseLatency()
+    {
+        return m_responseLatency;
+    }
+    void pinRequestDelay(uint16_t microseconds);
+    void unpinRequestDelay();
+
+    // Corrupted data received from the MiP is skipped over, one byte at a time, until the start of the next valid
+    // frame is found. These functions report how many received bytes have been skipped since the last clear.
+    uint16_t skippedByteCount()
+    {
+        return m_rxSkippedBytes;
+    }
+    void clearSkippedByteCount()
+    {
+        m_rxSkippedBytes = 0;
+    }
+
+#if MIP_ENABLE_STATS
+    // Protocol statistics for each command sent to the MiP since begin() or the last call to resetStats().
+    void snapshotStats(MiPStats& stats);
+    void resetStats();
+#endif
+
+#if MIP_TRACE_SIZE > 0
+    // The trace holds the most recent requests sent to the MiP and frames received from it. dumpTrace() sends it to
+    // the PC in the binary format described in the README.
+    void dumpTrace();
+    void clearTrace();
+#endif
+
+    // By default, each function which sends a request to the MiP waits until the MiP is ready to accept it. Once async
+    // requests are enabled, requests which don't need a response from the MiP are instead queued up and sent from
+    // update() as the MiP becomes ready for them. The sketch should then call update() frequently from loop(). If the
+    // queue is already full, the request waits for the oldest queued one to be sent, just as it would without async
+    // requests.
+    void update();
+    void enableAsyncRequests();
+    void disableAsyncRequests();
+    bool areAsyncRequestsEnabled();
+
+    // Once serial slots are set, update() only gives the UART to the PC once every mipSlotMillis milliseconds and then
+    // only sends as much buffered Serial output as can be transmitted in pcSlotMillis milliseconds. Setting
+    // mipSlotMillis to 0 (the default) sends buffered output as soon as each line is complete.
+    void     setSerialSlots(uint16_t mipSlotMillis, uint16_t pcSlotMillis);
+    uint16_t getMiPSlot();
+    uint16_t getPCSlot();
+
+    // Callbacks registered with these functions are called as soon as the matching notification is decoded, from
+    // within update() or any other call which processes data received from the MiP. Gesture, clap, shake, IR code and
+    // MiP detection events passed to a callback aren't also queued up for the read functions so pass NULL to go back
+    // to polling for them. The status callback is only called when the battery voltage or position changes. Callbacks
+    // shouldn't call MiP functions which send requests to the MiP.
+    void onGesture(MiPGestureCallback callback);
+    void onRadar(MiPRadarCallback callback);
+    void onClap(MiPClapCallback callback);
+    void onShake(MiPShakeCallback callback);
+    void onStatusChange(MiPStatusCallback callback);
+    void onIRCode(MiPIRCodeCallback callback);
+    void onMiPDetected(MiPDetectedCallback callback);
+
+    // Selects whether gesture, clap, IR code and MiP detection events which arrive while their queue is full overwrite
+    // the oldest queued event (the default) or are thrown away. Either way they are counted by droppedGestureEvents()
+    // and friends. The read functions which take an arrivalTime return the lower 16 bits of millis() when each event
+    // was received, so (uint16_t)millis() - arrivalTime is how long it has been queued, up to about 65 seconds. When
+    // built with MIP_USE_ISR_RECEIVE, this is when the interrupt handler received the end of the notification.
+    // Otherwise it is when update() first read the start of the notification, so it is late by however long the
+    // notification sat in the UART's buffer, which depends on how often the sketch calls update().
+    void setEventOverflowPolicy(MiPEventOverflowPolicy policy);
+
+    // The chest LED, head LEDs, volume, game mode, gesture/radar mode and clap settings last confirmed with the MiP are
+    // remembered and writes which wouldn't change them are skipped. Call invalidateCachedSettings() if the MiP may have
+    // changed them on its own (after being reset, for example) so that the next writes are sent to the MiP again.
+    // forceWriteChestLED(), forceWriteHeadLEDs() and forceWriteVolume() always send just that one write instead, since
+    // the LEDs and volume can also be changed behind the library's back while the MiP keeps running, by a game mode or
+    // the MiP app for example. The gesture/radar mode and clap settings only change when asked to by this library or
+    // when the MiP is reset, and only the app game mode is remembered since the others can finish on their own, so
+    // invalidateCachedSettings() is all that those need.
+    // begin() starts out with nothing remembered and a verified call which gives up because the MiP stopped answering
+    // forgets everything, since the MiP may have been reset in the meantime.
+    void invalidateCachedSettings();
+
+    // Once the read cache is enabled, functions like readVolume() and isGestureModeEnabled() return the setting last
+    // confirmed with the MiP, without sending a request, as long as it was confirmed within timeToLive milliseconds.
+    void enableReadCache(uint16_t timeToLive);
+    void disableReadCache();
+    bool isReadCacheEnabled();
+
     void enableRadarMode();
     void disableRadarMode();
     void enableGestureMode();
@@ -427,10 +974,15 @@ public:
     MiPRadar readRadar();
     uint8_t availableGestureEvents();
     MiPGesture readGestureEvent();
+    MiPGesture readGestureEvent(uint16_t& arrivalTime);
+    uint16_t droppedGestureEvents();
 
     void writeChestLED(uint8_t red, uint8_t green, uint8_t blue);
     void writeChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime);
     void writeChestLED(const MiPChestLED& chestLED);
+    void forceWriteChestLED(uint8_t red, uint8_t green, uint8_t blue);
+    void forceWriteChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime);
+    void forceWriteChestLED(const MiPChestLED& chestLED);
     void readChestLED(MiPChestLED& chestLED);
     void unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue);
     void unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime);
@@ -438,6 +990,8 @@ public:
 
     void writeHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4);
     void writeHeadLEDs(const MiPHeadLEDs& headLEDs);
+    void forceWriteHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4);
+    void forceWriteHeadLEDs(const MiPHeadLEDs& headLEDs);
     void readHeadLEDs(MiPHeadLEDs& headLEDs);
     void unverifiedWriteHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4);
     void unverifiedWriteHeadLEDs(const MiPHeadLEDs& headLEDs);
@@ -459,7 +1013,38 @@ public:
     void addEntryToSoundList(MiPSoundIndex sound, uint16_t delay = 0, MiPVolume volume = MIP_VOLUME_DEFAULT);
     void playSoundList(uint8_t repeatCount = 0);
 
+    // Plays a sequence of MiPSoundEntry objects stored in PROGMEM. Sequences longer than the 8 entries which fit in a
+    // sound list are sent to the MiP 8 entries at a time from update(), each time the previous group of sounds should
+    // have finished playing.
+    template<size_t Length>
+    void playSoundSequence(const MiPSoundEntry (&sequence)[Length])
+    {
+        static_assert(Length <= 255, "Sound sequences can't have more than 255 entries.");
+        playSoundSequence(sequence, Length);
+    }
+    void playSoundSequence(const MiPSoundEntry* pSequence, uint8_t length);
+    bool isSoundSequencePlaying();
+    void stopSoundSequence();
+
+    // Sounds passed to queueSound() are played one after the other from update(), without blocking. A sound with a
+    // higher priority than the one playing cuts it off and plays right away. Otherwise it waits in the queue behind any
+    // sounds of the same or higher priority. Returns false if the queue was full of sounds with at least the same
+    // priority. Sounds played with playSound(), playSoundList() and playSoundSequence() cut off the queue's current
+    // sound and the queue waits for them before playing its next one. The queue only knows when a sound should be done
+    // from estimateSoundDuration() so sounds can overlap or be followed by a gap.
+    bool    queueSound(MiPSoundIndex sound, uint8_t priority = 0, MiPVolume volume = MIP_VOLUME_DEFAULT);
+    bool    isSoundPlaying();
+    uint8_t queuedSoundCount();
+    void    clearSoundQueue();
+    void    onSoundFinished(MiPSoundFinishedCallback callback);
+
+    // Returns a guess at how many milliseconds the MiP takes to play a sound. The queue and sound sequences rely on
+    // these guesses to decide when a sound is done since the MiP doesn't say. They haven't been measured on a robot so
+    // they can be off by a second or more.
+    uint16_t estimateSoundDuration(MiPSoundIndex sound);
+
     void writeVolume(uint8_t volume);
+    void forceWriteVolume(uint8_t volume);
     uint8_t readVolume();
 
     float readDistanceTravelled();
@@ -484,6 +1069,8 @@ public:
     uint16_t readClapDelay();
     uint8_t  availableClapEvents();
     uint8_t  readClapEvent();
+    uint8_t  readClapEvent(uint16_t& arrivalTime);
+    uint16_t droppedClapEvents();
 
     bool hasBeenShaken();
 
@@ -510,14 +1097,20 @@ public:
     void     disableMiPDetectionMode();
     bool     isMiPDetectionModeEnabled();
     uint8_t  readDetectedMiP();
+    uint8_t  readDetectedMiP(uint16_t& arrivalTime);
     uint8_t  availableDetectedMiPEvents();
+    uint16_t droppedDetectedMiPEvents();
     void     enableIRRemoteControl();
     void     disableIRRemoteControl();
     bool     isIRRemoteControlEnabled();
     void     sendIRDongleCode(uint16_t sendCode, uint8_t transmitPower);
     uint32_t readIRDongleCode();
+    uint32_t readIRDongleCode(uint16_t& arrivalTime);
     uint8_t  availableIRCodeEvents();
+    uint16_t droppedIRCodeEvents();
 
+    // When built with MIP_USE_ISR_RECEIVE set to 1, rawReceive() only supports requests for the commands with responses
+    // listed in g_mipCommandInfo (mip_protocol.h) since the interrupt handler needs to know the length of each frame.
     void   rawSend(const uint8_t request[], size_t requestLength);
     int8_t rawReceive(const uint8_t request[], size_t requestLength,
                       uint8_t responseBuffer[], size_t responseBufferSize, size_t& responseLength);
@@ -527,35 +1120,15 @@ public:
     // code will automatically end up calling these functions for you as needed.
     void switchSerialToMiP()
     {
-        if (isSerialGoingToMiP())
-        {
-            return;
-        }
-
-        Serial.flush();
-        if (m_mipBaudRate != 115200)
-        {
-            Serial.begin(m_mipBaudRate);
-        }
-        digitalWrite(m_serialSelectPin, HIGH);
+        m_pTransport->selectMiP();
     }
     void switchSerialToPC()
     {
-        if (!isSerialGoingToMiP())
-        {
-            return;
-        }
-
-        Serial.flush();
-        if (m_mipBaudRate != 115200)
-        {
-            Serial.begin(115200);
-        }
-        digitalWrite(m_serialSelectPin, LOW);
+        m_pTransport->selectPC();
     }
     bool isSerialGoingToMiP()
     {
-        return digitalRead(m_serialSelectPin) == HIGH;
+        return m_pTransport->isMiPSelected();
     }
     static void switchInstanceSerialToMiP()
     {
@@ -586,6 +1159,36 @@ public:
 protected:
     void    clear();
     int8_t  attemptMiPConnection(uint32_t baudRate);
+    uint32_t readLastConnectionBaudRate();
+    void    rememberConnection();
+
+    void    cacheSetting(uint8_t setting);
+    void    uncacheSetting(uint8_t setting);
+    bool    isSettingCached(uint8_t setting);
+    bool    isCachedSettingFresh(uint8_t setting);
+    void    cacheChestLED(const MiPChestLED& chestLED);
+    void    cacheHeadLEDs(const MiPHeadLEDs& headLEDs);
+    void    cacheVolume(uint8_t volume);
+    void    cacheGameMode(MiPGameMode mode);
+    void    cacheGestureRadarMode(MiPGestureRadarMode mode);
+    void    cacheClapSettings(const MiPClapSettings& settings);
+
+    void     beginRetries();
+    bool     shouldRetry(int8_t result);
+    uint16_t calculateRetryDelay();
+    void     updateLinkHealth(bool succeeded);
+
+    void     statsRecordRequest(uint8_t command);
+    void     statsRecordResponse(uint8_t command, uint32_t latency);
+    void     statsRecordTimeout(uint8_t command);
+    void     statsRecordFailure(int8_t result);
+    void     statsRecordRetry();
+    void     statsRecordOob(uint8_t command);
+
+    void     traceRecord(uint8_t flags, const uint8_t* pData, uint8_t length);
+#if MIP_TRACE_SIZE > 0
+    void     traceAppend(const uint8_t* pData, uint8_t length);
+#endif
 
     void    verifiedSetGestureRadarMode(MiPGestureRadarMode desiredMode);
     bool    checkGestureRadarMode(MiPGestureRadarMode expectedMode);
@@ -602,6 +1205,15 @@ protected:
 
     void    fallDown(MiPFallDirection direction);
 
+    void     sendSound(MiPSoundIndex sound, MiPVolume volume);
+    void     sendSoundSequenceChunk();
+    void     updateSoundSequence();
+    void     startQueuedSound(MiPSoundIndex sound, uint8_t priority, MiPVolume volume);
+    void     interruptQueuedSound();
+    bool     isUnqueuedSoundPlaying();
+    void     notifySoundFinished(MiPSoundIndex sound, bool interrupted);
+    void     updateSoundQueue();
+
     void    rawSetVolume(uint8_t volume);
     int8_t  rawGetVolume(uint8_t& volume);
 
@@ -636,27 +1248,109 @@ protected:
     int8_t  rawGetIRRemoteControl(uint8_t& remoteControl);
 
     void    transportSendRequest(const uint8_t* pRequest, size_t requestLength, int expectResponse);
+    bool    transportIsReadyForRequest();
+    void    transportWriteRequest(const uint8_t* pRequest, size_t requestLength);
+    uint32_t transportTransmitTime(size_t byteCount);
+    void    transportUpdateRequestDelay(uint32_t responseLatency);
+    void    transportSendQueuedRequests();
+    void    transportFlushRequestQueue();
     int8_t  transportGetResponse(uint8_t* pResponseBuffer, size_t responseBufferSize, size_t* pResponseLength);
     bool    processAllResponseData();
-    void    copyHexTextToBinary(uint8_t* pDest, uint8_t* pSrc, uint8_t length);
-    uint8_t parseHexDigit(uint8_t digit);
-    void    processOobResponseData(uint8_t commandByte);
+    bool    processDecodedFrames();
+    bool    processResponseByte(uint8_t byte);
+    bool    processCompletedFrame();
+    bool    processResponseDigit(uint8_t digit);
+    bool    processReplayedDigits();
+    bool    decodeResponseDigit(uint8_t digit);
+    bool    copyHexTextToBinary(uint8_t* pDest, const uint8_t* pSrc, uint8_t length);
+    bool    processOobResponseData(const uint8_t* pFrame, uint8_t frameLength);
+    bool    processStatusNotification(const uint8_t* pFrame, uint8_t frameLength);
+    bool    isResponseFrameInProgress();
+    void    resyncResponseDecoder();
+    void    skipResponseDigits(uint8_t count);
+    void    resetResponseDecoder();
     uint8_t discardUnexpectedSerialData();
 
     // Bits that can be set in m_flags bitfield.
     enum FlagBits
     {
-        MIP_FLAG_RADAR_VALID     = (1 << 0),
-        MIP_FLAG_SHAKE_DETECTED  = (1 << 1),
-        MIP_FLAG_WEIGHT_VALID    = (1 << 2),
-        MRI_FLAG_INITIALIZED     = (1 << 3)
+        MIP_FLAG_RADAR_VALID          = (1 << 0),
+        MIP_FLAG_SHAKE_DETECTED       = (1 << 1),
+        MIP_FLAG_WEIGHT_VALID         = (1 << 2),
+        MRI_FLAG_INITIALIZED          = (1 << 3),
+        MIP_FLAG_ASYNC_REQUESTS       = (1 << 4),
+        MIP_FLAG_RETRY_OVERRIDE       = (1 << 5),
+        MIP_FLAG_REQUEST_DELAY_PINNED = (1 << 6)
+    };
+
+    // Settings which can be cached in the m_cached* fields. The m_cachedSettings bitfield has (1 << setting) set for
+    // each one which is known to match the MiP and m_cachedTimes[setting] records when it was last confirmed.
+    enum CachedSetting
+    {
+        MIP_CACHED_CHEST_LED = 0,
+        MIP_CACHED_HEAD_LEDS,
+        MIP_CACHED_VOLUME,
+        MIP_CACHED_GAME_MODE,
+        MIP_CACHED_GESTURE_RADAR_MODE,
+        MIP_CACHED_CLAP_SETTINGS,
+        MIP_CACHED_SETTING_COUNT
+    };
+
+    // Bits that can be set in m_rxFlags bitfield.
+    enum RxFlagBits
+    {
+        MIP_RX_FLAG_RESPONSE        = (1 << 0),     // Frame being decoded is the response to the last request.
+        MIP_RX_FLAG_VARIABLE_LENGTH = (1 << 1)      // Second byte of frame being decoded holds length of the rest.
+    };
+
+    // Functions registered to be called when notifications arrive from the MiP. They are kept across calls to begin().
+    struct Callbacks
+    {
+        Callbacks()
+        {
+            memset(this, 0, sizeof(*this));
+        }
+
+        MiPGestureCallback  gesture;
+        MiPRadarCallback    radar;
+        MiPClapCallback     clap;
+        MiPShakeCallback    shake;
+        MiPStatusCallback   statusChange;
+        MiPIRCodeCallback   irCode;
+        MiPDetectedCallback detectedMiP;
+        MiPSoundFinishedCallback soundFinished;
     };
 
+    // Sounds waiting to be played by the sound queue.
+    struct QueuedSound
+    {
+        uint8_t sound;
+        uint8_t volume;
+        uint8_t priority;
+    };
+
+    // Notification queued up for the read functions along with the lower 16 bits of millis() when it arrived.
+    template<class EventType>
+    struct TimedEvent
+    {
+        EventType value;
+        uint16_t  arrivalTime;
+    };
+
+    // Requests waiting in m_requestQueue to be sent to the MiP.
+    struct QueuedRequest
+    {
+        uint8_t length;
+        uint8_t data[MIP_REQUEST_MAX_LEN];
+    };
+
+    MiPTransport*                m_pTransport;
     uint32_t                     m_lastRequestTime;
     uint32_t                     m_lastContinuousDriveTime;
     uint32_t                     m_mipBaudRate;
+    uint16_t                     m_requestDelay;
+    uint16_t                     m_responseLatency;
     uint8_t                      m_flags;
-    int8_t                       m_serialSelectPin;
     uint8_t                      m_responseBuffer[MIP_RESPONSE_MAX_LEN];
     uint8_t                      m_expectedResponseCommand;
     uint8_t                      m_expectedResponseSize;
@@ -664,14 +1358,68 @@ protected:
     uint8_t                      m_playCommand[1+17];
     int8_t                       m_soundIndex;
     uint8_t                      m_playVolume;
+    const MiPSoundEntry*         m_pSoundSequence;
+    uint8_t                      m_soundSequenceLength;
+    uint8_t                      m_soundSequenceIndex;
+    uint32_t                     m_soundSequenceChunkEndTime;
+    QueuedSound                  m_soundQueue[MIP_SOUND_QUEUE_SIZE];
+    uint8_t                      m_soundQueueLength;
+    uint8_t                      m_currentSound;
+    uint8_t                      m_currentSoundPriority;
+    uint32_t                     m_currentSoundEndTime;
+    bool                         m_isSoundListPlaying;
+    uint32_t                     m_soundListEndTime;
     MiPRadar                     m_lastRadar;
     MiPStatus                    m_lastStatus;
     int8_t                       m_lastWeight;
-    CircularQueue<uint8_t, 8>    m_clapEvents;
-    CircularQueue<MiPGesture, 8> m_gestureEvents;
-    CircularQueue<uint32_t, 8>   m_irCodeEvents;
-    CircularQueue<uint8_t, 8>    m_detectedMiPEvents;
+    CircularQueue<TimedEvent<uint8_t>, MIP_CLAP_QUEUE_SIZE> m_clapEvents;
+    CircularQueue<TimedEvent<MiPGesture>, MIP_GESTURE_QUEUE_SIZE> m_gestureEvents;
+    CircularQueue<TimedEvent<uint32_t>, MIP_IR_CODE_QUEUE_SIZE> m_irCodeEvents;
+    CircularQueue<TimedEvent<uint8_t>, MIP_DETECTED_MIP_QUEUE_SIZE> m_detectedMiPEvents;
+    CircularQueue<QueuedRequest, MIP_REQUEST_QUEUE_SIZE> m_requestQueue;
+    Callbacks                    m_callbacks;
     uint8_t                      m_irId;
+    MiPRetryPolicy               m_retryPolicy;
+    MiPRetryPolicy               m_retryPolicyOverride;
+    const MiPRetryPolicy*        m_pActiveRetryPolicy;
+    uint32_t                     m_retryStartTime;
+    uint8_t                      m_retryAttempt;
+    uint8_t                      m_linkHealth;
+    uint16_t                     m_retryCount;
+    uint16_t                     m_mipSlotMillis;
+    uint16_t                     m_pcSlotMillis;
+    uint32_t                     m_mipSlotStartTime;
+#if MIP_ENABLE_STATS
+    MiPStats                     m_stats;
+    uint8_t                      m_statsLastResponseCommand;
+#endif
+#if MIP_TRACE_SIZE > 0
+    uint8_t                      m_trace[MIP_TRACE_SIZE];
+    uint16_t                     m_traceStart;
+    uint16_t                     m_traceLength;
+    uint16_t                     m_traceOverwritten;
+#endif
+    uint8_t                      m_cachedSettings;
+    uint16_t                     m_readCacheTTL;
+    uint32_t                     m_cachedTimes[MIP_CACHED_SETTING_COUNT];
+    MiPChestLED                  m_cachedChestLED;
+    MiPHeadLEDs                  m_cachedHeadLEDs;
+    uint8_t                      m_cachedVolume;
+    MiPGameMode                  m_cachedGameMode;
+    MiPGestureRadarMode          m_cachedGestureRadarMode;
+    MiPClapSettings              m_cachedClapSettings;
+    uint32_t                     m_rxLastDigitTime;
+    uint16_t                     m_rxFrameArrivalTime;
+    uint8_t                      m_rxFrame[MIP_RESPONSE_MAX_LEN];
+    uint8_t                      m_rxFrameLength;
+    uint8_t                      m_rxFrameSize;
+    uint8_t                      m_rxHighDigit;
+    uint8_t                      m_rxFlags;
+    uint8_t                      m_rxReplay[MIP_RESPONSE_MAX_LEN * 2];
+    uint8_t                      m_rxReplayIndex;
+    uint8_t                      m_rxReplayLength;
+    uint8_t                      m_rxResyncSkippedBytes;
+    uint16_t                     m_rxSkippedBytes;
 
     static MiP*                  s_pInstance;
 };
@@ -706,10 +1454,28 @@ public:
     inline size_t write(int n) { return write((uint8_t)n); }
     operator bool() { return true; }
 
-protected:
-    void initIfNeeded();
+    // Sends up to maxLength bytes of the output still sitting in the buffer to the PC. Unlike flush(), it doesn't wait
+    // for the UART to finish transmitting so it returns right away if there is nothing buffered.
+    void sendBufferedOutput(uint8_t maxLength = 0xFF);
+    // Number of bytes waiting in the buffer to be sent to the PC.
+    uint8_t bufferedOutputLength();
+    // By default, the buffer is sent as soon as a complete line has been written to it. MiP::setSerialSlots() turns
+    // this off so that update() can decide when to send it instead.
+    void sendEachLine(bool enable) { m_sendEachLine = enable; }
+    // Number of times that output had to switch the UART away from the MiP to send it to the PC.
+    uint16_t muxSwitchCount() { return m_muxSwitchCount; }
 
-    bool m_isInit;
+protected:
+    void   initIfNeeded();
+    size_t writeToPC(const uint8_t* pBuffer, size_t size);
+
+#if MIP_STREAM_BUFFER_SIZE > 0
+    uint8_t  m_buffer[MIP_STREAM_BUFFER_SIZE];
+    uint8_t  m_bufferLength;
+#endif
+    uint16_t m_muxSwitchCount;
+    bool     m_sendEachLine;
+    bool     m_isInit;
 } extern MiPStream;
 
 // This macro will force user code which does something like: Serial.println("Interesting text")
@@ -0,0 +1,426 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Interrupt driven USART driver which decodes the MiP's hex text into binary frames as it is received. Only built
+   when MIP_USE_ISR_RECEIVE is set to 1.
+*/
+#include "mip.h"
+
+#if MIP_USE_ISR_RECEIVE
+
+#include <avr/interrupt.h>
+#include "mip_protocol.h"
+
+// Make sure that this module refers to the actual Serial object and not the redirection to MiPStream.
+#undef Serial
+
+
+// Partially received frames are thrown away if the next digit doesn't arrive within this many milliseconds. It is
+// timed with the lower 8 bits of millis() so it must be less than 256.
+#define MIP_ISR_FRAME_TIMEOUT   100
+
+// Older cores and parts with a single USART don't number its registers and vectors.
+#if !defined(UCSR0A) && defined(UCSRA)
+    #define UCSR0A  UCSRA
+    #define UCSR0B  UCSRB
+    #define UCSR0C  UCSRC
+    #define UBRR0H  UBRRH
+    #define UBRR0L  UBRRL
+    #define UDR0    UDR
+    #define U2X0    U2X
+    #define UPE0    PE
+    #define UDRE0   UDRE
+    #define TXC0    TXC
+    #define RXEN0   RXEN
+    #define TXEN0   TXEN
+    #define RXCIE0  RXCIE
+#endif
+#if defined(USART_RX_vect)
+    #define MIP_USART_RX_VECT USART_RX_vect
+#elif defined(USART0_RX_vect)
+    #define MIP_USART_RX_VECT USART0_RX_vect
+#else
+    #define MIP_USART_RX_VECT USART_RXC_vect
+#endif
+
+
+MiPIsrSerial::MiPIsrSerial()
+{
+    m_droppedFrames = 0;
+    m_skippedDigits = 0;
+    m_isDecodingFrames = false;
+    m_hasWritten = false;
+    m_lastDigitTime = 0;
+    resetFrameDecoder();
+}
+
+void MiPIsrSerial::begin(unsigned long baud, uint8_t config)
+{
+    // Use the same baud rate calculation as the Arduino core's HardwareSerial, including its workaround for the
+    // bootloader of the Duemilanove and older boards which expect 57600 baud without U2X.
+    uint16_t baudSetting = (F_CPU / 4 / baud - 1) / 2;
+    UCSR0A = 1 << U2X0;
+    if (((F_CPU == 16000000UL) && (baud == 57600)) || (baudSetting > 4095))
+    {
+        UCSR0A = 0;
+        baudSetting = (F_CPU / 8 / baud - 1) / 2;
+    }
+    UBRR0H = baudSetting >> 8;
+    UBRR0L = baudSetting;
+    UCSR0C = config;
+
+    m_hasWritten = false;
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+void MiPIsrSerial::end()
+{
+    flush();
+    UCSR0B = 0;
+    m_pcBuffer.clear();
+}
+
+int MiPIsrSerial::available()
+{
+    return m_pcBuffer.available();
+}
+
+int MiPIsrSerial::read()
+{
+    uint8_t byte;
+    if (!m_pcBuffer.pop(byte))
+    {
+        return -1;
+    }
+    return byte;
+}
+
+int MiPIsrSerial::peek()
+{
+    uint8_t byte;
+    if (!m_pcBuffer.peek(byte))
+    {
+        return -1;
+    }
+    return byte;
+}
+
+size_t MiPIsrSerial::write(uint8_t byte)
+{
+    // There is no transmit buffer so wait for the USART to be ready for the next byte. Clearing TXC0 at the same
+    // time as loading UDR0 lets flush() know when this byte has been completely shifted out.
+    while ((UCSR0A & (1 << UDRE0)) == 0)
+    {
+    }
+    UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0);
+    UDR0 = byte;
+    m_hasWritten = true;
+    return 1;
+}
+
+int MiPIsrSerial::availableForWrite()
+{
+    return (UCSR0A & (1 << UDRE0)) ? 1 : 0;
+}
+
+void MiPIsrSerial::flush()
+{
+    if (!m_hasWritten)
+    {
+        // TXC0 is never set if nothing has been transmitted since begin().
+        return;
+    }
+    while ((UCSR0A & (1 << TXC0)) == 0)
+    {
+    }
+}
+
+void MiPIsrSerial::enableFrameDecoding()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+        resetFrameDecoder();
+        m_isDecodingFrames = true;
+    SREG = oldSREG;
+}
+
+void MiPIsrSerial::disableFrameDecoding()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+        resetFrameDecoder();
+        m_isDecodingFrames = false;
+    SREG = oldSREG;
+}
+
+uint8_t MiPIsrSerial::readFrame(uint8_t* pFrame, uint8_t frameSize, uint16_t& arrivalTime)
+{
+    Frame frame;
+    if (!m_frameQueue.pop(frame))
+    {
+        return 0;
+    }
+
+    uint8_t frameLength = frame.length < frameSize ? frame.length : frameSize;
+    memcpy(pFrame, frame.data, frameLength);
+    arrivalTime = frame.arrivalTime;
+    return frameLength;
+}
+
+uint16_t MiPIsrSerial::droppedFrameCount()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+        uint16_t count = m_droppedFrames;
+    SREG = oldSREG;
+    return count;
+}
+
+uint16_t MiPIsrSerial::skippedDigitCount()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+        uint16_t count = m_skippedDigits;
+    SREG = oldSREG;
+    return count;
+}
+
+void MiPIsrSerial::receiveByte(uint8_t byte)
+{
+    if (!m_isDecodingFrames)
+    {
+        // Characters from the PC are buffered as they are. They are dropped if the buffer is full.
+        m_pcBuffer.push(byte);
+        return;
+    }
+
+    // Throw away any partially received frame if the rest of it took too long to show up.
+    uint8_t currTime = (uint8_t)millis();
+    if ((m_frameLength > 0 || m_highDigit != 0) && (uint8_t)(currTime - m_lastDigitTime) >= MIP_ISR_FRAME_TIMEOUT)
+    {
+        m_skippedDigits += m_frameLength * 2 + (m_highDigit != 0);
+        resetFrameDecoder();
+    }
+    m_lastDigitTime = currTime;
+
+    decodeDigit(byte);
+}
+
+// This internal protected method pairs up hex digits into bytes and adds them to the frame being assembled. It is only
+// called from the receive interrupt handler.
+void MiPIsrSerial::decodeDigit(uint8_t digit)
+{
+    uint8_t lowNibble = mipParseHexDigit(digit);
+    if (lowNibble == MIP_INVALID_HEX_DIGIT)
+    {
+        // A character which isn't a hex digit can't be part of any frame. Start over with the next digit.
+        m_skippedDigits += 1 + m_frameLength * 2 + (m_highDigit != 0);
+        resetFrameDecoder();
+        return;
+    }
+    if (m_highDigit == 0)
+    {
+        m_highDigit = digit;
+        return;
+    }
+    uint8_t byte = (mipParseHexDigit(m_highDigit) << 4) | lowNibble;
+    m_highDigit = 0;
+
+    if (m_frameLength == 0)
+    {
+        // The command byte determines how many bytes make up the rest of the frame. Unlike the MiP class, the frame
+        // size comes straight from the descriptor since the interrupt handler doesn't know which response is expected.
+        // This is why MiP::rawReceive() only supports commands listed in g_mipCommandInfo when built this way.
+        uint16_t descriptor = mipLookupCommandDescriptor(byte);
+        uint8_t  flags = mipDescriptorFlags(descriptor);
+        if ((flags & (MIP_CMD_FLAG_RESPONSE | MIP_CMD_FLAG_OOB)) == 0)
+        {
+            // Not the start of a frame. Slide forward one digit so that the low digit can start the next pair.
+            m_skippedDigits++;
+            m_highDigit = digit;
+            return;
+        }
+        m_isVariableLength = (flags & MIP_CMD_FLAG_VARIABLE_LENGTH) != 0;
+        m_frameSize = 1 + mipDescriptorResponseLength(descriptor);
+    }
+    else if (m_frameLength == 1 && m_isVariableLength)
+    {
+        // MIP_CMD_RECEIVE_IR_DONGLE_CODE is the only message delivered by MiP that has a
+        // variable length so the second byte contains the length of the rest of the frame.
+        if (byte < 2 || byte > 4)
+        {
+            m_skippedDigits += 4;
+            resetFrameDecoder();
+            return;
+        }
+        m_frameSize = 2 + byte;
+    }
+    m_frame.data[m_frameLength++] = byte;
+
+    if (m_frameLength >= m_frameSize)
+    {
+        queueFrame();
+        resetFrameDecoder();
+    }
+}
+
+// This internal protected method hands the frame just decoded over to readFrame(). It is only called from the receive
+// interrupt handler.
+void MiPIsrSerial::queueFrame()
+{
+    // Stamp the frame now rather than when loop() gets around to reading it.
+    m_frame.arrivalTime = (uint16_t)millis();
+    m_frame.length = m_frameLength;
+    if (!m_frameQueue.push(m_frame))
+    {
+        m_droppedFrames++;
+    }
+}
+
+void MiPIsrSerial::resetFrameDecoder()
+{
+    m_frameLength = 0;
+    m_frameSize = 0;
+    m_highDigit = 0;
+    m_isVariableLength = false;
+}
+
+ISR(MIP_USART_RX_VECT)
+{
+    uint8_t status = UCSR0A;
+    uint8_t byte = UDR0;
+
+    // Bytes with parity errors are thrown away, like HardwareSerial does.
+    if (status & (1 << UPE0))
+    {
+        return;
+    }
+    IsrSerial.receiveByte(byte);
+}
+
+// Instantiate the single instance of this driver.
+MiPIsrSerial IsrSerial;
+
+
+
+// MiPTransport which talks to the MiP through IsrSerial, optionally shared with the PC via a TS3USB221A.
+MiPIsrTransport::MiPIsrTransport(MiPIsrSerial& serial, int8_t selectPin /* = -1 */)
+{
+    m_pSerial = &serial;
+    m_baudRate = MIP_BAUD_RATE;
+    m_selectPin = selectPin;
+}
+
+void MiPIsrTransport::begin()
+{
+    if (m_selectPin < 0)
+    {
+        // The port is dedicated to the MiP so everything received on it should be decoded.
+        m_pSerial->enableFrameDecoding();
+        return;
+    }
+
+    // Configure the pin used to select the UART destination between the MiP and PC. Start out connected to the PC.
+    pinMode(m_selectPin, OUTPUT);
+    digitalWrite(m_selectPin, LOW);
+}
+
+void MiPIsrTransport::end()
+{
+    if (m_selectPin < 0)
+    {
+        // The port isn't shared with MiPStream so it is up to this transport to shut it down.
+        m_pSerial->disableFrameDecoding();
+        m_pSerial->end();
+        return;
+    }
+
+    pinMode(m_selectPin, INPUT);
+}
+
+void MiPIsrTransport::setBaudRate(uint32_t baudRate)
+{
+    m_baudRate = baudRate;
+    m_pSerial->begin(baudRate);
+}
+
+int MiPIsrTransport::available()
+{
+    return 0;
+}
+
+int MiPIsrTransport::read()
+{
+    return -1;
+}
+
+size_t MiPIsrTransport::write(uint8_t byte)
+{
+    return m_pSerial->write(byte);
+}
+
+void MiPIsrTransport::flush()
+{
+    m_pSerial->flush();
+}
+
+void MiPIsrTransport::selectMiP()
+{
+    if (m_selectPin < 0 || isMiPSelected())
+    {
+        return;
+    }
+
+    m_pSerial->flush();
+    if (m_baudRate != MIP_BAUD_RATE)
+    {
+        m_pSerial->begin(m_baudRate);
+    }
+    m_pSerial->enableFrameDecoding();
+    digitalWrite(m_selectPin, HIGH);
+}
+
+void MiPIsrTransport::selectPC()
+{
+    if (m_selectPin < 0 || !isMiPSelected())
+    {
+        return;
+    }
+
+    m_pSerial->flush();
+    m_pSerial->disableFrameDecoding();
+    if (m_baudRate != MIP_BAUD_RATE)
+    {
+        // The PC always communicates at 115200 baud.
+        m_pSerial->begin(MIP_BAUD_RATE);
+    }
+    digitalWrite(m_selectPin, LOW);
+}
+
+bool MiPIsrTransport::isMiPSelected()
+{
+    if (m_selectPin < 0)
+    {
+        // Port isn't shared with the PC.
+        return false;
+    }
+    return digitalRead(m_selectPin) == HIGH;
+}
+
+uint8_t MiPIsrTransport::readFrame(uint8_t* pFrame, uint8_t frameSize, uint16_t& arrivalTime)
+{
+    return m_pSerial->readFrame(pFrame, frameSize, arrivalTime);
+}
+
+#endif // MIP_USE_ISR_RECEIVE
@@ -0,0 +1,75 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Diagnostic events that the MiP library logs to the PC. This header is shared with the decoder in
+   extras/mip_log_decoder so that the two always agree on the event ids, their arguments and the record layout.
+*/
+#ifndef MIP_LOG_H_
+#define MIP_LOG_H_
+
+#include <stdint.h>
+
+// Values for MIP_LOG_MODE.
+// MIP_LOG_TEXT sends each diagnostic to the PC as a line of text, like "MiP: Response timeout".
+// MIP_LOG_BINARY sends each diagnostic as a fixed size MIP_LOG_RECORD_SIZE byte record instead. This saves the flash
+// used by the text and the time spent formatting and sending it, but the records must be turned back into text by
+// extras/mip_log_decoder on the PC.
+#define MIP_LOG_TEXT    0
+#define MIP_LOG_BINARY  1
+
+#ifndef MIP_LOG_MODE
+    #define MIP_LOG_MODE MIP_LOG_TEXT
+#endif
+
+// Binary log records are made up of (all multi-byte values are little endian):
+//   Offset Size Contents
+//   0      1    MIP_LOG_MARKER
+//   1      1    Event id (MIP_LOG_* from the table below)
+//   2      2    Lower 16 bits of millis() when the event was logged
+//   4      4    Arguments, interpreted as described by the event's MIP_LOG_ARGS_* type
+//   8      1    MIP_LOG_CHECKSUM() of bytes 1 - 7
+// The marker is outside of the 7-bit ASCII range so that the decoder can pick records out from between the text that a
+// sketch prints itself.
+#define MIP_LOG_RECORD_SIZE     9
+#define MIP_LOG_MARKER          0xA5
+#define MIP_LOG_CHECKSUM(SUM)   ((uint8_t)~(SUM))
+
+// How the 4 bytes of arguments in each record are interpreted.
+#define MIP_LOG_ARGS_NONE       0   // No arguments.
+#define MIP_LOG_ARGS_U16        1   // One unsigned 16-bit argument in bytes 4 - 5.
+#define MIP_LOG_ARGS_U16_U16    2   // Two unsigned 16-bit arguments in bytes 4 - 5 and 6 - 7.
+#define MIP_LOG_ARGS_U32        3   // One unsigned 32-bit argument in bytes 4 - 7.
+#define MIP_LOG_ARGS_I16        4   // One signed 16-bit argument in bytes 4 - 5.
+
+// Table of the events which can be logged. Each entry gives the event's id, the type of its arguments and the
+// printf() style format used to display it. New events must be added to the end so that existing logs can still be
+// decoded.
+//      X(ID,                       VALUE, ARGS,                 FORMAT)
+#define MIP_LOG_EVENTS(X) \
+        X(MIP_LOG_ASSERT,               1, MIP_LOG_ARGS_U16,     "MiP Assert: mip.cpp:%u") \
+        X(MIP_LOG_CONNECTED,            2, MIP_LOG_ARGS_U32,     "MiP: Connected at %lu baud.") \
+        X(MIP_LOG_API_RESULT,           3, MIP_LOG_ARGS_I16,     "MiP: API returned %d") \
+        X(MIP_LOG_RESPONSE_TIMEOUT,     4, MIP_LOG_ARGS_U16,     "MiP: Response timeout (command 0x%02X)") \
+        X(MIP_LOG_RESPONSE_TOO_SHORT,   5, MIP_LOG_ARGS_U16_U16, "MiP: Response too short: %u,%u") \
+        X(MIP_LOG_OOB_TOO_SHORT,        6, MIP_LOG_ARGS_U16_U16, "MiP: OOB too short: %u,%u") \
+        X(MIP_LOG_RESYNC_SKIPPED,       7, MIP_LOG_ARGS_U16,     "MiP: Skipped %u bytes to resync")
+
+#define MIP_LOG_ENUM_ENTRY(ID, VALUE, ARGS, FORMAT) ID = VALUE,
+enum MiPLogEvent
+{
+    MIP_LOG_EVENTS(MIP_LOG_ENUM_ENTRY)
+};
+#undef MIP_LOG_ENUM_ENTRY
+
+#endif // MIP_LOG_H_
@@ -0,0 +1,198 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Description of the MiP UART protocol used internally by the MiP library. The request senders and the response parser
+   both get their frame lengths from here so that there is only one place to update when a command is added.
+*/
+#ifndef MIP_PROTOCOL_H_
+#define MIP_PROTOCOL_H_
+
+#include <stdint.h>
+
+// Baud rate to use for MiP/PC communications.
+#define MIP_BAUD_RATE 115200
+
+// Slower baud rate used by newer MiP robots.
+#define MIP_SLOWER_BAUD_RATE 9600
+
+
+// MiP Protocol Commands.
+// These command codes are placed in the first byte of requests sent to the MiP and responses sent back from the MiP.
+// See https://github.com/WowWeeLabs/MiP-BLE-Protocol/blob/master/MiP-Protocol.md for more information.
+#define MIP_CMD_RECEIVE_IR_DONGLE_CODE  0x03
+#define MIP_CMD_GET_DETECTED_MIP        0x04
+#define MIP_CMD_PLAY_SOUND              0x06
+#define MIP_CMD_SET_POSITION            0x08
+#define MIP_CMD_GET_GESTURE_RESPONSE    0x0A
+#define MIP_CMD_SET_GESTURE_RADAR_MODE  0x0C
+#define MIP_CMD_GET_RADAR_RESPONSE      0x0C
+#define MIP_CMD_GET_GESTURE_RADAR_MODE  0x0D
+#define MIP_CMD_SET_DETECTION_MODE      0x0E
+#define MIP_CMD_SET_IR_REMOTE_CONTROL   0x10
+#define MIP_CMD_GET_IR_REMOTE_CONTROL   0x11
+#define MIP_CMD_SET_USER_DATA           0x12
+#define MIP_CMD_GET_USER_DATA           0x13
+#define MIP_CMD_GET_SOFTWARE_VERSION    0x14
+#define MIP_CMD_SET_VOLUME              0x15
+#define MIP_CMD_GET_VOLUME              0x16
+#define MIP_CMD_GET_HARDWARE_INFO       0x19
+#define MIP_CMD_SHAKE_RESPONSE          0x1A
+#define MIP_CMD_CLAP_RESPONSE           0x1D
+#define MIP_CMD_ENABLE_CLAP             0x1E
+#define MIP_CMD_GET_CLAP_SETTINGS       0x1F
+#define MIP_CMD_SET_CLAP_DELAY          0x20
+#define MIP_CMD_GET_UP                  0x23
+#define MIP_CMD_DISTANCE_DRIVE          0x70
+#define MIP_CMD_DRIVE_FORWARD           0x71
+#define MIP_CMD_DRIVE_BACKWARD          0x72
+#define MIP_CMD_TURN_LEFT               0x73
+#define MIP_CMD_TURN_RIGHT              0x74
+#define MIP_CMD_SET_GAME_MODE           0x76
+#define MIP_CMD_STOP                    0x77
+#define MIP_CMD_CONTINUOUS_DRIVE        0x78
+#define MIP_CMD_GET_STATUS              0x79
+#define MIP_CMD_GET_WEIGHT              0x81
+#define MIP_CMD_GET_GAME_MODE           0x82
+#define MIP_CMD_GET_CHEST_LED           0x83
+#define MIP_CMD_SET_CHEST_LED           0x84
+#define MIP_CMD_READ_ODOMETER           0x85
+#define MIP_CMD_RESET_ODOMETER          0x86
+#define MIP_CMD_FLASH_CHEST_LED         0x89
+#define MIP_CMD_SET_HEAD_LEDS           0x8A
+#define MIP_CMD_GET_HEAD_LEDS           0x8B
+#define MIP_CMD_SEND_IR_DONGLE_CODE     0x8C
+#define MIP_CMD_SLEEP                   0xFA
+#define MIP_CMD_DISCONNECT_APP          0xFE
+
+
+// Flags used in the MiPCommandInfo list below to describe how each command byte is used.
+#define MIP_CMD_FLAG_RESPONSE           (1 << 0)    // MiP sends a response back for this request.
+#define MIP_CMD_FLAG_OOB                (1 << 1)    // MiP sends this as an out of band notification.
+#define MIP_CMD_FLAG_VARIABLE_LENGTH    (1 << 2)    // Byte after the command byte holds the length of the rest.
+
+struct MiPCommandInfo
+{
+    uint8_t command;
+    uint8_t requestLength;  // Number of request bytes which follow the command byte.
+    uint8_t responseLength; // Number of response or notification bytes which follow the command byte.
+    uint8_t flags;
+};
+
+// Every command byte known to the library. The response length of MIP_CMD_RECEIVE_IR_DONGLE_CODE only covers its
+// length byte since the rest of the notification has a variable length.
+static constexpr MiPCommandInfo g_mipCommandInfo[] =
+{
+    // Command                          Request Response    Flags
+    { MIP_CMD_RECEIVE_IR_DONGLE_CODE,   0,      1,          MIP_CMD_FLAG_OOB | MIP_CMD_FLAG_VARIABLE_LENGTH },
+    { MIP_CMD_GET_DETECTED_MIP,         0,      1,          MIP_CMD_FLAG_OOB },
+    { MIP_CMD_PLAY_SOUND,               17,     0,          0 },
+    { MIP_CMD_SET_POSITION,             1,      0,          0 },
+    { MIP_CMD_GET_GESTURE_RESPONSE,     0,      1,          MIP_CMD_FLAG_OOB },
+    { MIP_CMD_SET_GESTURE_RADAR_MODE,   1,      1,          MIP_CMD_FLAG_OOB }, // Also MIP_CMD_GET_RADAR_RESPONSE.
+    { MIP_CMD_GET_GESTURE_RADAR_MODE,   0,      1,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SET_DETECTION_MODE,       2,      0,          0 },
+    { MIP_CMD_SET_IR_REMOTE_CONTROL,    1,      0,          0 },
+    { MIP_CMD_GET_IR_REMOTE_CONTROL,    0,      1,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SET_USER_DATA,            2,      0,          0 },
+    { MIP_CMD_GET_USER_DATA,            1,      2,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_GET_SOFTWARE_VERSION,     0,      4,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SET_VOLUME,               1,      0,          0 },
+    { MIP_CMD_GET_VOLUME,               0,      1,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_GET_HARDWARE_INFO,        0,      2,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SHAKE_RESPONSE,           0,      0,          MIP_CMD_FLAG_OOB },
+    { MIP_CMD_CLAP_RESPONSE,            0,      1,          MIP_CMD_FLAG_OOB },
+    { MIP_CMD_ENABLE_CLAP,              1,      0,          0 },
+    { MIP_CMD_GET_CLAP_SETTINGS,        0,      3,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SET_CLAP_DELAY,           2,      0,          0 },
+    { MIP_CMD_GET_UP,                   1,      0,          0 },
+    { MIP_CMD_DISTANCE_DRIVE,           5,      0,          0 },
+    { MIP_CMD_DRIVE_FORWARD,            2,      0,          0 },
+    { MIP_CMD_DRIVE_BACKWARD,           2,      0,          0 },
+    { MIP_CMD_TURN_LEFT,                2,      0,          0 },
+    { MIP_CMD_TURN_RIGHT,               2,      0,          0 },
+    { MIP_CMD_SET_GAME_MODE,            1,      0,          0 },
+    { MIP_CMD_STOP,                     0,      0,          0 },
+    { MIP_CMD_CONTINUOUS_DRIVE,         2,      0,          0 },
+    { MIP_CMD_GET_STATUS,               0,      2,          MIP_CMD_FLAG_RESPONSE | MIP_CMD_FLAG_OOB },
+    { MIP_CMD_GET_WEIGHT,               0,      1,          MIP_CMD_FLAG_RESPONSE | MIP_CMD_FLAG_OOB },
+    { MIP_CMD_GET_GAME_MODE,            0,      1,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_GET_CHEST_LED,            0,      5,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SET_CHEST_LED,            3,      0,          0 },
+    { MIP_CMD_READ_ODOMETER,            0,      4,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_RESET_ODOMETER,           0,      0,          0 },
+    { MIP_CMD_FLASH_CHEST_LED,          5,      0,          0 },
+    { MIP_CMD_SET_HEAD_LEDS,            4,      0,          0 },
+    { MIP_CMD_GET_HEAD_LEDS,            0,      4,          MIP_CMD_FLAG_RESPONSE },
+    { MIP_CMD_SEND_IR_DONGLE_CODE,      6,      0,          0 },
+    { MIP_CMD_SLEEP,                    0,      0,          0 },
+    { MIP_CMD_DISCONNECT_APP,           0,      0,          0 },
+};
+
+#define MIP_COMMAND_INFO_COUNT (sizeof(g_mipCommandInfo) / sizeof(g_mipCommandInfo[0]))
+
+
+// Each command byte's MiPCommandInfo entry is packed into a 16-bit descriptor so that the library can store a
+// descriptor for every possible byte value in a table and look them up in O(1) time.
+//  Bits 0 - 4: Request length.
+//  Bits 5 - 7: Response / notification length.
+//  Bits 8 - 10: MIP_CMD_FLAG_* flags.
+//  Bit 15: Set for command bytes known to the library.
+// A descriptor of 0 (MIP_DESCRIPTOR_UNKNOWN) is used for all unknown command bytes.
+#define MIP_DESCRIPTOR_UNKNOWN  0x0000
+#define MIP_DESCRIPTOR_KNOWN    0x8000
+
+static constexpr uint16_t mipPackDescriptor(const MiPCommandInfo& info)
+{
+    return MIP_DESCRIPTOR_KNOWN | (uint16_t)info.flags << 8 | info.responseLength << 5 | info.requestLength;
+}
+
+// Searches g_mipCommandInfo for the specified command byte at compile time and returns its packed descriptor.
+static constexpr uint16_t mipCommandDescriptor(uint8_t command, uint8_t index = 0)
+{
+    return index >= MIP_COMMAND_INFO_COUNT ? MIP_DESCRIPTOR_UNKNOWN :
+           g_mipCommandInfo[index].command == command ? mipPackDescriptor(g_mipCommandInfo[index]) :
+           mipCommandDescriptor(command, index + 1);
+}
+
+static constexpr uint8_t mipDescriptorRequestLength(uint16_t descriptor)
+{
+    return descriptor & 0x1F;
+}
+
+static constexpr uint8_t mipDescriptorResponseLength(uint16_t descriptor)
+{
+    return (descriptor >> 5) & 0x07;
+}
+
+static constexpr uint8_t mipDescriptorFlags(uint16_t descriptor)
+{
+    return descriptor >> 8;
+}
+
+// Returns the packed descriptor for the specified command byte, looked up at run time from a table stored in program
+// memory.
+uint16_t mipLookupCommandDescriptor(uint8_t commandByte);
+
+// Value returned by mipParseHexDigit() for characters which aren't valid hex digits.
+#define MIP_INVALID_HEX_DIGIT 0xFF
+
+// Returns the 4-bit value of a hex digit sent by the MiP or MIP_INVALID_HEX_DIGIT if it isn't a valid hex digit. Shared
+// by the MiP class and the interrupt driven decoder in IsrSerial so that there is only one copy of the lookup table.
+uint8_t mipParseHexDigit(uint8_t digit);
+
+// Number of bytes in the response to the specified command, including the command byte itself. Evaluated at compile
+// time so it can be used to size response buffers.
+#define MIP_RESPONSE_LENGTH(COMMAND) (1 + mipDescriptorResponseLength(mipCommandDescriptor(COMMAND)))
+
+#endif // MIP_PROTOCOL_H_
@@ -0,0 +1,609 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Implementation of simulated MiP robot. */
+#include "mip_simulator.h"
+#include "mip_protocol.h"
+
+
+// Byte sent by the MiP library to enable the MiP's UART communication channel.
+#define MIP_SIMULATOR_CONNECT_BYTE 0xFF
+
+// Range of addresses used by the MiP for user data.
+#define MIP_SIMULATOR_FIRST_USER_DATA_ADDRESS 0x20
+#define MIP_SIMULATOR_LAST_USER_DATA_ADDRESS  0x2F
+
+// Range of raw battery levels reported in status notifications, from 4.0V to 6.4V.
+#define MIP_SIMULATOR_BATTERY_EMPTY 0x4D
+#define MIP_SIMULATOR_BATTERY_FULL  0x7C
+
+// The odometer counts 48.5 ticks for each cm travelled.
+#define MIP_SIMULATOR_TICKS_PER_2CM 97
+
+
+#if MIP_USE_SIMULATOR
+MiPSimulator& mipDefaultSimulator()
+{
+    // Constructed on first use so that it is still around when a global MiP object is destroyed.
+    static MiPSimulator simulator;
+    return simulator;
+}
+#endif
+
+
+
+MiPSimulator::MiPSimulator(uint32_t baudRate /* = 115200 */)
+{
+    m_mipBaudRate = baudRate;
+    m_baudRate = baudRate;
+    // 8-N-1 so 10 bits per byte.
+    m_byteTime = 10000000UL / baudRate;
+    m_responseLatency = MIP_SIMULATOR_RESPONSE_LATENCY;
+    m_minRequestGap = MIP_SIMULATOR_MIN_REQUEST_GAP;
+    m_statusInterval = MIP_SIMULATOR_STATUS_INTERVAL;
+    m_random = m_faults.seed;
+
+    clear();
+}
+
+void MiPSimulator::clear()
+{
+    m_output.clear();
+    m_chestLED.clear();
+    m_chestLED.blue = 0xFC;
+    m_headLEDs.clear();
+    m_clapSettings.clear();
+    m_gameMode = MIP_APP_MODE;
+    m_gestureRadarMode = MIP_GESTURE_RADAR_DISABLED;
+    m_position = MIP_POSITION_UPRIGHT;
+    m_odometerTicks = 0;
+    m_requestEndTime = micros();
+    m_requestStartTime = m_requestEndTime;
+    m_lastRequestEndTime = m_requestEndTime - m_minRequestGap;
+    m_outputTime = m_requestEndTime;
+    m_lastStatusTime = millis();
+    m_requestByteCount = 0;
+    m_responseByteCount = 0;
+    m_requestCount = 0;
+    m_ignoredRequestCount = 0;
+    m_requestLength = 0;
+    m_requestSize = 0;
+    m_releasedBytes = 0;
+    memset(m_userData, 0, sizeof(m_userData));
+    m_volume = MIP_VOLUME_7;
+    m_battery = 0x70;
+    m_lastSound = 0;
+    memset(m_lastSoundList, 0, sizeof(m_lastSoundList));
+    m_lastSoundListTime = m_requestEndTime;
+    m_soundListCount = 0;
+    m_irRemoteControl = 0;
+    m_detectionId = 0;
+    m_weight = 0;
+    m_isConnected = false;
+    m_isSleeping = false;
+    m_ignoreRequest = false;
+}
+
+void MiPSimulator::setMiPBaudRate(uint32_t baudRate)
+{
+    m_mipBaudRate = baudRate;
+    m_byteTime = 10000000UL / baudRate;
+    clear();
+}
+
+void MiPSimulator::begin()
+{
+    // There is no hardware to claim.
+}
+
+void MiPSimulator::end()
+{
+}
+
+void MiPSimulator::setBaudRate(uint32_t baudRate)
+{
+    // The simulated MiP only understands requests sent at its own baud rate.
+    m_baudRate = baudRate;
+}
+
+int MiPSimulator::available()
+{
+    update();
+    return m_releasedBytes;
+}
+
+int MiPSimulator::read()
+{
+    uint8_t byte = 0;
+
+    update();
+    if (m_releasedBytes == 0)
+    {
+        return -1;
+    }
+    m_output.pop(byte);
+    m_releasedBytes--;
+    return byte;
+}
+
+size_t MiPSimulator::write(uint8_t byte)
+{
+    update();
+
+    // Each byte finishes arriving at the MiP one byte time after the one before it.
+    uint32_t currentTime = micros();
+    if ((int32_t)(currentTime - m_requestEndTime) > 0)
+    {
+        m_requestEndTime = currentTime;
+    }
+    m_requestEndTime += m_byteTime;
+    m_requestByteCount++;
+
+    if (m_baudRate != m_mipBaudRate)
+    {
+        // The MiP just sees garbage when the baud rates don't match.
+        return 1;
+    }
+    processRequestByte(byte);
+    return 1;
+}
+
+void MiPSimulator::flush()
+{
+}
+
+void MiPSimulator::setResponseLatency(uint16_t microseconds)
+{
+    m_responseLatency = microseconds;
+}
+
+void MiPSimulator::setMinRequestGap(uint16_t microseconds)
+{
+    m_minRequestGap = microseconds;
+}
+
+void MiPSimulator::setStatusInterval(uint16_t milliseconds)
+{
+    m_statusInterval = milliseconds;
+}
+
+void MiPSimulator::setFaults(const MiPSimulatorFaults& faults)
+{
+    m_faults = faults;
+    m_random = faults.seed;
+}
+
+void MiPSimulator::injectGesture(MiPGesture gesture)
+{
+    if (m_gestureRadarMode != MIP_GESTURE)
+    {
+        return;
+    }
+
+    const uint8_t notification[] = { MIP_CMD_GET_GESTURE_RESPONSE, gesture };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::injectRadar(MiPRadar radar)
+{
+    if (m_gestureRadarMode != MIP_RADAR)
+    {
+        return;
+    }
+
+    const uint8_t notification[] = { MIP_CMD_GET_RADAR_RESPONSE, radar };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::injectClap(uint8_t count)
+{
+    if (m_clapSettings.enabled != MIP_CLAP_ENABLED)
+    {
+        return;
+    }
+
+    const uint8_t notification[] = { MIP_CMD_CLAP_RESPONSE, count };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::injectShake()
+{
+    const uint8_t notification[] = { MIP_CMD_SHAKE_RESPONSE };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::injectDetectedMiP(uint8_t id)
+{
+    if (m_detectionId == 0)
+    {
+        return;
+    }
+
+    const uint8_t notification[] = { MIP_CMD_GET_DETECTED_MIP, id };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::injectIRDongleCode(uint32_t code)
+{
+    const uint8_t notification[] = { MIP_CMD_RECEIVE_IR_DONGLE_CODE, 4,
+                                     (uint8_t)(code >> 24), (uint8_t)(code >> 16),
+                                     (uint8_t)(code >> 8), (uint8_t)code };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::setWeight(int8_t weight)
+{
+    m_weight = weight;
+
+    const uint8_t notification[] = { MIP_CMD_GET_WEIGHT, (uint8_t)weight };
+    sendNotification(notification, sizeof(notification));
+}
+
+void MiPSimulator::setBattery(float voltage)
+{
+    float level = (voltage - 4.0f) / (6.4f - 4.0f) * (MIP_SIMULATOR_BATTERY_FULL - MIP_SIMULATOR_BATTERY_EMPTY);
+    if (level < 0.0f)
+    {
+        level = 0.0f;
+    }
+    if (level > MIP_SIMULATOR_BATTERY_FULL - MIP_SIMULATOR_BATTERY_EMPTY)
+    {
+        level = MIP_SIMULATOR_BATTERY_FULL - MIP_SIMULATOR_BATTERY_EMPTY;
+    }
+    m_battery = MIP_SIMULATOR_BATTERY_EMPTY + (uint8_t)(level + 0.5f);
+    sendStatus();
+}
+
+void MiPSimulator::setPosition(MiPPosition position)
+{
+    m_position = position;
+    sendStatus();
+}
+
+// This internal protected method makes the digits which have finished arriving by now available to read() and sends
+// the periodic status notification when it is due.
+void MiPSimulator::update()
+{
+    uint32_t currentTime = micros();
+
+    while (m_releasedBytes < m_output.available() && (int32_t)(currentTime - m_outputTime) >= 0)
+    {
+        m_releasedBytes++;
+        m_outputTime += m_byteTime;
+    }
+
+    if (m_statusInterval != 0 && millis() - m_lastStatusTime >= m_statusInterval)
+    {
+        sendStatus();
+    }
+}
+
+// This internal protected method collects the bytes of each request sent to the simulated MiP and acts on the request
+// once all of its bytes have arrived.
+void MiPSimulator::processRequestByte(uint8_t byte)
+{
+    if (m_isSleeping)
+    {
+        // The MiP needs to be reset before it will listen again.
+        return;
+    }
+
+    if (m_requestLength == 0)
+    {
+        if (byte == MIP_SIMULATOR_CONNECT_BYTE)
+        {
+            // Switching over to the UART turns the chest LED green.
+            if (!m_isConnected)
+            {
+                m_chestLED.clear();
+                m_chestLED.green = 0xFF;
+            }
+            m_isConnected = true;
+            m_lastRequestEndTime = m_requestEndTime;
+            return;
+        }
+
+        // The MiP ignores everything else until the UART has been enabled and bytes which don't start a request.
+        uint16_t descriptor = mipLookupCommandDescriptor(byte);
+        uint8_t  flags = mipDescriptorFlags(descriptor);
+        uint8_t  requestLength = mipDescriptorRequestLength(descriptor);
+        if (!m_isConnected || descriptor == MIP_DESCRIPTOR_UNKNOWN ||
+            ((flags & MIP_CMD_FLAG_OOB) && !(flags & MIP_CMD_FLAG_RESPONSE) && requestLength == 0))
+        {
+            return;
+        }
+
+        // Requests which arrive too soon after the last one are ignored, just like on a real MiP.
+        m_requestStartTime = m_requestEndTime - m_byteTime;
+        m_requestSize = 1 + requestLength;
+        m_ignoreRequest = (int32_t)(m_requestStartTime - m_lastRequestEndTime) < (int32_t)m_minRequestGap ||
+                          randomChance(m_faults.dropRequest);
+    }
+
+    m_request[m_requestLength++] = byte;
+    if (m_requestLength < m_requestSize)
+    {
+        return;
+    }
+
+    m_requestCount++;
+    if (m_ignoreRequest)
+    {
+        m_ignoredRequestCount++;
+    }
+    else
+    {
+        processRequest();
+    }
+    m_lastRequestEndTime = m_requestEndTime;
+    m_requestLength = 0;
+}
+
+// This internal protected method updates the state of the simulated MiP for the request in m_request and sends back a
+// response if the request calls for one.
+void MiPSimulator::processRequest()
+{
+    uint8_t response[MIP_RESPONSE_MAX_LEN];
+    uint8_t responseLength = 0;
+    uint8_t address;
+
+    response[responseLength++] = m_request[0];
+    switch (m_request[0])
+    {
+    case MIP_CMD_PLAY_SOUND:
+        // Volume entries in the sound list change the volume for the sounds which follow and those played later.
+        m_lastSound = m_request[1];
+        memcpy(m_lastSoundList, &m_request[1], sizeof(m_lastSoundList));
+        m_lastSoundListTime = m_requestEndTime;
+        m_soundListCount++;
+        for (uint8_t i = 1 ; i < m_requestSize - 1 ; i += 2)
+        {
+            if (m_request[i] >= MIP_SOUND_VOLUME_OFF && m_request[i] <= MIP_SOUND_VOLUME_7)
+            {
+                m_volume = m_request[i] - MIP_SOUND_VOLUME_OFF;
+            }
+        }
+        break;
+    case MIP_CMD_SET_POSITION:
+        setPosition(m_request[1] == MIP_FALL_FACE_DOWN ? MIP_POSITION_FACE_DOWN : MIP_POSITION_ON_BACK);
+        break;
+    case MIP_CMD_SET_GESTURE_RADAR_MODE:
+        m_gestureRadarMode = (MiPGestureRadarMode)m_request[1];
+        break;
+    case MIP_CMD_GET_GESTURE_RADAR_MODE:
+        response[responseLength++] = m_gestureRadarMode;
+        break;
+    case MIP_CMD_SET_DETECTION_MODE:
+        m_detectionId = m_request[1];
+        break;
+    case MIP_CMD_SET_IR_REMOTE_CONTROL:
+        m_irRemoteControl = m_request[1];
+        break;
+    case MIP_CMD_GET_IR_REMOTE_CONTROL:
+        response[responseLength++] = m_irRemoteControl;
+        break;
+    case MIP_CMD_SET_USER_DATA:
+        address = m_request[1];
+        if (address >= MIP_SIMULATOR_FIRST_USER_DATA_ADDRESS && address <= MIP_SIMULATOR_LAST_USER_DATA_ADDRESS)
+        {
+            m_userData[address - MIP_SIMULATOR_FIRST_USER_DATA_ADDRESS] = m_request[2];
+        }
+        break;
+    case MIP_CMD_GET_USER_DATA:
+        address = m_request[1];
+        response[responseLength++] = address;
+        if (address >= MIP_SIMULATOR_FIRST_USER_DATA_ADDRESS && address <= MIP_SIMULATOR_LAST_USER_DATA_ADDRESS)
+        {
+            response[responseLength++] = m_userData[address - MIP_SIMULATOR_FIRST_USER_DATA_ADDRESS];
+        }
+        else
+        {
+            response[responseLength++] = 0x00;
+        }
+        break;
+    case MIP_CMD_GET_SOFTWARE_VERSION:
+        // Newer MiP robots, which communicate at 9600 baud, report newer firmware.
+        response[responseLength++] = m_mipBaudRate == 9600 ? 16 : 14;
+        response[responseLength++] = m_mipBaudRate == 9600 ? 5 : 11;
+        response[responseLength++] = m_mipBaudRate == 9600 ? 12 : 17;
+        response[responseLength++] = 1;
+        break;
+    case MIP_CMD_SET_VOLUME:
+        m_volume = m_request[1] > MIP_VOLUME_7 ? (uint8_t)MIP_VOLUME_7 : m_request[1];
+        break;
+    case MIP_CMD_GET_VOLUME:
+        response[responseLength++] = m_volume;
+        break;
+    case MIP_CMD_GET_HARDWARE_INFO:
+        response[responseLength++] = 1;
+        response[responseLength++] = m_mipBaudRate == 9600 ? 3 : 2;
+        break;
+    case MIP_CMD_ENABLE_CLAP:
+        m_clapSettings.enabled = (MiPClapEnabled)m_request[1];
+        break;
+    case MIP_CMD_GET_CLAP_SETTINGS:
+        response[responseLength++] = m_clapSettings.enabled;
+        response[responseLength++] = m_clapSettings.delay >> 8;
+        response[responseLength++] = m_clapSettings.delay & 0xFF;
+        break;
+    case MIP_CMD_SET_CLAP_DELAY:
+        m_clapSettings.delay = (uint16_t)m_request[1] << 8 | m_request[2];
+        break;
+    case MIP_CMD_GET_UP:
+        if ((m_position == MIP_POSITION_ON_BACK && m_request[1] != MIP_GETUP_FROM_FRONT) ||
+            (m_position == MIP_POSITION_FACE_DOWN && m_request[1] != MIP_GETUP_FROM_BACK))
+        {
+            setPosition(MIP_POSITION_UPRIGHT);
+        }
+        break;
+    case MIP_CMD_DISTANCE_DRIVE:
+        m_odometerTicks += (uint32_t)m_request[2] * MIP_SIMULATOR_TICKS_PER_2CM / 2;
+        break;
+    case MIP_CMD_DRIVE_FORWARD:
+    case MIP_CMD_DRIVE_BACKWARD:
+    case MIP_CMD_TURN_LEFT:
+    case MIP_CMD_TURN_RIGHT:
+    case MIP_CMD_STOP:
+    case MIP_CMD_CONTINUOUS_DRIVE:
+    case MIP_CMD_SEND_IR_DONGLE_CODE:
+        // Only the distance travelled by distance drive requests is simulated.
+        break;
+    case MIP_CMD_SET_GAME_MODE:
+        m_gameMode = (MiPGameMode)m_request[1];
+        break;
+    case MIP_CMD_GET_GAME_MODE:
+        response[responseLength++] = m_gameMode;
+        break;
+    case MIP_CMD_GET_STATUS:
+        response[responseLength++] = m_battery;
+        response[responseLength++] = m_position;
+        break;
+    case MIP_CMD_GET_WEIGHT:
+        response[responseLength++] = m_weight;
+        break;
+    case MIP_CMD_GET_CHEST_LED:
+        response[responseLength++] = m_chestLED.red;
+        response[responseLength++] = m_chestLED.green;
+        response[responseLength++] = m_chestLED.blue;
+        response[responseLength++] = m_chestLED.onTime / 20;
+        response[responseLength++] = m_chestLED.offTime / 20;
+        break;
+    case MIP_CMD_SET_CHEST_LED:
+    case MIP_CMD_FLASH_CHEST_LED:
+        // The blue channel is only 6-bit so the MiP zeroes out the lower 2 bits.
+        m_chestLED.red = m_request[1];
+        m_chestLED.green = m_request[2];
+        m_chestLED.blue = m_request[3] & ~3;
+        m_chestLED.onTime = m_request[0] == MIP_CMD_FLASH_CHEST_LED ? m_request[4] * 20 : 0;
+        m_chestLED.offTime = m_request[0] == MIP_CMD_FLASH_CHEST_LED ? m_request[5] * 20 : 0;
+        break;
+    case MIP_CMD_READ_ODOMETER:
+        response[responseLength++] = m_odometerTicks >> 24;
+        response[responseLength++] = m_odometerTicks >> 16;
+        response[responseLength++] = m_odometerTicks >> 8;
+        response[responseLength++] = m_odometerTicks;
+        break;
+    case MIP_CMD_RESET_ODOMETER:
+        m_odometerTicks = 0;
+        break;
+    case MIP_CMD_SET_HEAD_LEDS:
+        m_headLEDs.led1 = (MiPHeadLED)m_request[1];
+        m_headLEDs.led2 = (MiPHeadLED)m_request[2];
+        m_headLEDs.led3 = (MiPHeadLED)m_request[3];
+        m_headLEDs.led4 = (MiPHeadLED)m_request[4];
+        break;
+    case MIP_CMD_GET_HEAD_LEDS:
+        response[responseLength++] = m_headLEDs.led1;
+        response[responseLength++] = m_headLEDs.led2;
+        response[responseLength++] = m_headLEDs.led3;
+        response[responseLength++] = m_headLEDs.led4;
+        break;
+    case MIP_CMD_SLEEP:
+        m_isSleeping = true;
+        m_isConnected = false;
+        break;
+    case MIP_CMD_DISCONNECT_APP:
+        m_isConnected = false;
+        break;
+    }
+
+    if (responseLength > 1)
+    {
+        sendResponse(response, responseLength);
+    }
+}
+
+// This internal protected method sends a response to the request which just finished arriving.
+void MiPSimulator::sendResponse(const uint8_t* pFrame, uint8_t frameLength)
+{
+    uint32_t latency = m_responseLatency;
+
+    if (m_faults.latencyJitter != 0)
+    {
+        latency += nextRandom() % ((uint32_t)m_faults.latencyJitter + 1);
+    }
+    sendFrame(pFrame, frameLength, m_requestEndTime + latency);
+}
+
+// This internal protected method sends an out of band notification right away.
+void MiPSimulator::sendNotification(const uint8_t* pFrame, uint8_t frameLength)
+{
+    if (!m_isConnected)
+    {
+        return;
+    }
+    sendFrame(pFrame, frameLength, micros());
+}
+
+// This internal protected method queues up the hex text for a frame to be read once it has had time to arrive.
+void MiPSimulator::sendFrame(const uint8_t* pFrame, uint8_t frameLength, uint32_t startTime)
+{
+    if (randomChance(m_faults.dropResponse))
+    {
+        return;
+    }
+    if (randomChance(m_faults.junkByte))
+    {
+        sendOutputByte(nextRandom() >> 24, startTime);
+    }
+
+    for (uint8_t i = 0 ; i < frameLength * 2 ; i++)
+    {
+        uint8_t value = (i & 1) ? pFrame[i / 2] & 0xF : pFrame[i / 2] >> 4;
+        if (randomChance(m_faults.corruptDigit))
+        {
+            value = (value + 1 + nextRandom() % 15) & 0xF;
+        }
+        sendOutputByte(value < 10 ? '0' + value : 'A' + value - 10, startTime);
+    }
+}
+
+// This internal protected method queues up the next byte to be read. It starts arriving at startTime if nothing else is
+// still in the process of arriving.
+void MiPSimulator::sendOutputByte(uint8_t byte, uint32_t startTime)
+{
+    if (m_output.isFull())
+    {
+        // Overflowed the receive buffer so the byte is lost.
+        return;
+    }
+    if (m_releasedBytes == m_output.available())
+    {
+        m_outputTime = startTime + m_byteTime;
+    }
+    m_output.push(byte);
+    m_responseByteCount++;
+}
+
+// This internal protected method sends the MiP's current battery level and position as a notification.
+void MiPSimulator::sendStatus()
+{
+    const uint8_t notification[] = { MIP_CMD_GET_STATUS, m_battery, m_position };
+
+    m_lastStatusTime = millis();
+    sendNotification(notification, sizeof(notification));
+}
+
+// This internal protected method returns true the specified number of times out of 256.
+bool MiPSimulator::randomChance(uint8_t chance)
+{
+    return chance != 0 && (nextRandom() >> 24) < chance;
+}
+
+// This internal protected method returns the next number from a linear congruential generator.
+uint32_t MiPSimulator::nextRandom()
+{
+    m_random = m_random * 1664525UL + 1013904223UL;
+    return m_random;
+}
@@ -0,0 +1,189 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Simulated MiP robot which can be used in place of the real thing for testing and benchmarking the MiP library. It is
+   a MiPTransport so it is hooked up by passing it to the MiP constructor:
+     MiPSimulator simulatedMiP;
+     MiP          mip(simulatedMiP);
+*/
+#ifndef MIP_SIMULATOR_H_
+#define MIP_SIMULATOR_H_
+
+#include "mip.h"
+
+
+// Number of hex digits that the simulated MiP can have waiting to be read before it starts dropping them, like a real
+// UART receive buffer overflowing.
+#ifndef MIP_SIMULATOR_OUTPUT_SIZE
+    #define MIP_SIMULATOR_OUTPUT_SIZE 64
+#endif
+
+// Default timing of the simulated MiP.
+#define MIP_SIMULATOR_RESPONSE_LATENCY  2000    // Microseconds from the end of a request to the start of its response.
+#define MIP_SIMULATOR_MIN_REQUEST_GAP   1000    // Requests which start sooner than this many microseconds after the end
+                                                // of the previous one are ignored.
+#define MIP_SIMULATOR_STATUS_INTERVAL   1000    // Milliseconds between periodic status notifications. 0 disables them.
+
+
+// Faults which MiPSimulator can be configured to inject. Chances are out of 256 so 0 never injects the fault and 255
+// nearly always does. The faults are driven by a pseudo random generator started from seed so that a failing run can be
+// repeated exactly.
+class MiPSimulatorFaults
+{
+public:
+    MiPSimulatorFaults()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        dropRequest = 0;
+        dropResponse = 0;
+        corruptDigit = 0;
+        junkByte = 0;
+        latencyJitter = 0;
+        seed = 1;
+    }
+
+    uint8_t  dropRequest;   // Chance that a request is ignored by the MiP.
+    uint8_t  dropResponse;  // Chance that a response or notification is never sent.
+    uint8_t  corruptDigit;  // Chance that each hex digit sent is changed to a different one.
+    uint8_t  junkByte;      // Chance that a junk byte is sent before a response or notification.
+    uint16_t latencyJitter; // Up to this many microseconds are randomly added to the latency of each response.
+    uint32_t seed;
+};
+
+
+
+class MiPSimulator : public MiPTransport
+{
+public:
+    // baudRate is the rate at which the simulated MiP communicates. Older MiP robots use 115200 and newer ones 9600.
+    MiPSimulator(uint32_t baudRate = 115200);
+
+    // Returns the simulated MiP to its power-up state.
+    void clear();
+    // Swaps in a MiP which communicates at a different baud rate, starting in its power-up state.
+    void setMiPBaudRate(uint32_t baudRate);
+
+    // Methods that must be implemented for MiPTransport subclasses.
+    virtual void   begin();
+    virtual void   end();
+    virtual void   setBaudRate(uint32_t baudRate);
+    virtual int    available();
+    virtual int    read();
+    virtual size_t write(uint8_t byte);
+    virtual void   flush();
+
+    // Configure the timing and faults of the simulated MiP.
+    void setResponseLatency(uint16_t microseconds);
+    void setMinRequestGap(uint16_t microseconds);
+    void setStatusInterval(uint16_t milliseconds);
+    void setFaults(const MiPSimulatorFaults& faults);
+
+    // Events detected by the simulated MiP's sensors. They are only reported if the MiP has been configured to do so.
+    void injectGesture(MiPGesture gesture);
+    void injectRadar(MiPRadar radar);
+    void injectClap(uint8_t count);
+    void injectShake();
+    void injectDetectedMiP(uint8_t id);
+    void injectIRDongleCode(uint32_t code);
+    void setWeight(int8_t weight);
+    void setBattery(float voltage);
+    void setPosition(MiPPosition position);
+
+    // Inspect the state of the simulated MiP.
+    bool        isConnected()   { return m_isConnected; }
+    bool        isSleeping()    { return m_isSleeping; }
+    MiPPosition position()      { return m_position; }
+    uint8_t     volume()        { return m_volume; }
+    MiPGameMode gameMode()      { return m_gameMode; }
+    uint8_t     lastSound()     { return m_lastSound; }
+    uint32_t    odometerTicks() { return m_odometerTicks; }
+    uint16_t    requestCount()  { return m_requestCount; }
+    uint16_t    ignoredRequestCount() { return m_ignoredRequestCount; }
+
+    // The 8 entries and repeat count of the last sound list played, the micros() time at which it arrived and the
+    // number of sound lists played since the last clear().
+    const uint8_t* lastSoundList()  { return m_lastSoundList; }
+    uint32_t    lastSoundListTime() { return m_lastSoundListTime; }
+    uint16_t    soundListCount()    { return m_soundListCount; }
+
+    // Number of bytes sent to the simulated MiP and sent back by it, including notifications, since the last clear().
+    uint32_t    requestByteCount()  { return m_requestByteCount; }
+    uint32_t    responseByteCount() { return m_responseByteCount; }
+
+protected:
+    void     update();
+    void     processRequestByte(uint8_t byte);
+    void     processRequest();
+    void     sendResponse(const uint8_t* pFrame, uint8_t frameLength);
+    void     sendNotification(const uint8_t* pFrame, uint8_t frameLength);
+    void     sendFrame(const uint8_t* pFrame, uint8_t frameLength, uint32_t startTime);
+    void     sendOutputByte(uint8_t byte, uint32_t startTime);
+    void     sendStatus();
+    bool     randomChance(uint8_t chance);
+    uint32_t nextRandom();
+
+    CircularQueue<uint8_t, MIP_SIMULATOR_OUTPUT_SIZE> m_output;
+    MiPSimulatorFaults  m_faults;
+    MiPChestLED         m_chestLED;
+    MiPHeadLEDs         m_headLEDs;
+    MiPClapSettings     m_clapSettings;
+    MiPGameMode         m_gameMode;
+    MiPGestureRadarMode m_gestureRadarMode;
+    MiPPosition         m_position;
+    uint32_t            m_mipBaudRate;
+    uint32_t            m_baudRate;
+    uint32_t            m_random;
+    uint32_t            m_odometerTicks;
+    uint32_t            m_requestStartTime;
+    uint32_t            m_requestEndTime;
+    uint32_t            m_lastRequestEndTime;
+    uint32_t            m_outputTime;
+    uint32_t            m_lastStatusTime;
+    uint32_t            m_requestByteCount;
+    uint32_t            m_responseByteCount;
+    uint32_t            m_lastSoundListTime;
+    uint16_t            m_byteTime;
+    uint16_t            m_responseLatency;
+    uint16_t            m_minRequestGap;
+    uint16_t            m_statusInterval;
+    uint16_t            m_requestCount;
+    uint16_t            m_ignoredRequestCount;
+    uint16_t            m_soundListCount;
+    uint8_t             m_request[MIP_REQUEST_MAX_LEN];
+    uint8_t             m_requestLength;
+    uint8_t             m_requestSize;
+    uint8_t             m_releasedBytes;
+    uint8_t             m_userData[16];
+    uint8_t             m_lastSoundList[17];
+    uint8_t             m_volume;
+    uint8_t             m_battery;
+    uint8_t             m_lastSound;
+    uint8_t             m_irRemoteControl;
+    uint8_t             m_detectionId;
+    int8_t              m_weight;
+    bool                m_isConnected;
+    bool                m_isSleeping;
+    bool                m_ignoreRequest;
+};
+
+#if MIP_USE_SIMULATOR
+// Returns the simulated MiP used by MiP objects created with the default constructor.
+MiPSimulator& mipDefaultSimulator();
+#endif
+
+#endif // MIP_SIMULATOR_H_
@@ -12,30 +12,57 @@
    See the License for the specific language governing permissions and
    limitations under the License.
 */
-/* Circular queue used internally by MiP library. Overwrites oldest items once it is full.
+/* Queues used internally by MiP library.
 
+   CircularQueue overwrites oldest items once it is full, unless set to QUEUE_DROP_NEWEST, and counts the items lost.
+   Sizes which are a power of 2 are the cheapest to push and pop.
    NOT THREAD SAFE!
    ****************
+
+   SpscQueue can be pushed from an interrupt handler and popped from loop(), or the other way around, without disabling
+   interrupts. It drops the newest item if it is full.
 */
 #ifndef QUEUE_H_
 #define QUEUE_H_
 
 #include <stdint.h>
 
+// What CircularQueue::push() does when the queue is already full.
+enum QueueOverflowPolicy
+{
+    QUEUE_OVERWRITE_OLDEST = 0,
+    QUEUE_DROP_NEWEST = 1
+};
+
 template<class ElementType, uint8_t Size>
 class CircularQueue
 {
 public:
     CircularQueue()
     {
+        m_policy = QUEUE_OVERWRITE_OLDEST;
         clear();
     }
 
+    // Empties the queue and resets its dropped count. The overflow policy is left as is.
     void clear()
     {
         m_count = 0;
         m_readIndex = 0;
         m_writeIndex = 0;
+        m_dropped = 0;
+    }
+
+    void setOverflowPolicy(QueueOverflowPolicy policy)
+    {
+        m_policy = policy;
+    }
+
+    // Number of elements lost since the last clear(), either overwritten or rejected depending on the overflow policy.
+    // Stops counting at 65535.
+    uint16_t droppedCount()
+    {
+        return m_dropped;
     }
     
     bool isEmpty()
@@ -43,13 +70,28 @@ public:
         return m_count == 0;
     }
 
+    bool isFull()
+    {
+        return m_count == Size;
+    }
+
     uint8_t available()
     {
         return m_count;
     }
 
-    void push(const ElementType& element)
+    // Returns false if the queue was full and element was dropped because of the QUEUE_DROP_NEWEST policy.
+    bool push(const ElementType& element)
     {
+        if (m_count == Size)
+        {
+            countDrop();
+            if (m_policy == QUEUE_DROP_NEWEST)
+            {
+                return false;
+            }
+        }
+
         m_elements[m_writeIndex] = element;
         advanceWriteIndex();
         if (m_count < Size)
@@ -61,6 +103,7 @@ public:
             // Queue was full so oldest response was overwritten. Increment read index to discard oldest.
             advanceReadIndex();
         }
+        return true;
     }
 
     bool pop(ElementType& element)
@@ -78,36 +121,217 @@ public:
     }
 
 protected:
-    void advanceWriteIndex()
+    void countDrop()
     {
-        if (m_writeIndex == Size - 1)
-        {
-            // Wrap around to beginning of circular queue.
-            m_writeIndex = 0;
-        }
-        else
+        if (m_dropped != 0xFFFF)
         {
-            m_writeIndex++;
+            m_dropped++;
         }
     }
+
+    void advanceWriteIndex()
+    {
+        m_writeIndex = nextIndex(m_writeIndex);
+    }
     
     void advanceReadIndex()
     {
-        if (m_readIndex == Size - 1)
+        m_readIndex = nextIndex(m_readIndex);
+    }
+
+    static uint8_t nextIndex(uint8_t index)
+    {
+        if ((Size & (Size - 1)) == 0)
         {
-            // Wrap around to beginning of circular queue.
-            m_readIndex = 0;
+            // Size is a power of 2 so the index can be wrapped around with a mask rather than a compare and branch.
+            return (index + 1) & (Size - 1);
         }
-        else
+        if (index == Size - 1)
         {
-            m_readIndex++;
+            // Wrap around to beginning of circular queue.
+            return 0;
         }
+        return index + 1;
     }
 
     ElementType m_elements[Size];
+    uint16_t    m_dropped;
     uint8_t     m_count;
     uint8_t     m_readIndex;
     uint8_t     m_writeIndex;
+    uint8_t     m_policy;
+};
+
+// A queue with a Size of 0 has no room for elements. It drops everything pushed into it and is always empty.
+template<class ElementType>
+class CircularQueue<ElementType, 0>
+{
+public:
+    CircularQueue()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_dropped = 0;
+    }
+
+    void setOverflowPolicy(QueueOverflowPolicy policy)
+    {
+        // Silence compiler warnings about unused parameters.
+        (void)policy;
+    }
+
+    uint16_t droppedCount()
+    {
+        return m_dropped;
+    }
+
+    bool isEmpty()
+    {
+        return true;
+    }
+
+    bool isFull()
+    {
+        return true;
+    }
+
+    uint8_t available()
+    {
+        return 0;
+    }
+
+    bool push(const ElementType& element)
+    {
+        // Silence compiler warnings about unused parameters.
+        (void)element;
+        if (m_dropped != 0xFFFF)
+        {
+            m_dropped++;
+        }
+        return false;
+    }
+
+    bool pop(ElementType& element)
+    {
+        // Silence compiler warnings about unused parameters.
+        (void)element;
+        return false;
+    }
+
+protected:
+    uint16_t m_dropped;
+};
+
+
+// Reads and writes the indices of a SpscQueue which hand its elements over to the other side. They keep the compiler,
+// and the CPU on hosts that need it, from moving accesses to the elements across the index update. The AVR reads and
+// writes a byte atomically so it only needs a compiler barrier. Elsewhere the indices are accessed atomically with
+// acquire and release ordering, which is also what lets ThreadSanitizer see that the elements are handed over safely.
+static inline uint8_t spscQueueLoadAcquire(const volatile uint8_t* pIndex)
+{
+#if defined(__AVR__)
+    uint8_t index = *pIndex;
+    __asm__ __volatile__ ("" ::: "memory");
+    return index;
+#else
+    return __atomic_load_n(pIndex, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void spscQueueStoreRelease(volatile uint8_t* pIndex, uint8_t index)
+{
+#if defined(__AVR__)
+    __asm__ __volatile__ ("" ::: "memory");
+    *pIndex = index;
+#else
+    __atomic_store_n(pIndex, index, __ATOMIC_RELEASE);
+#endif
+}
+
+// Lock free queue for a single producer and a single consumer, each of which may be an interrupt handler. The producer
+// only writes m_head and the consumer only writes m_tail. Both are free running 8-bit counters, which the AVR reads and
+// writes atomically, so Size must be a power of 2 no larger than 128. All Size elements can be used.
+//
+// push() drops the new element and returns false if the queue is full since the producer can't safely move m_tail to
+// overwrite the oldest. clear() must only be called while neither side is using the queue.
+template<class ElementType, uint8_t Size>
+class SpscQueue
+{
+public:
+    static_assert(Size > 0 && Size <= 128 && (Size & (Size - 1)) == 0, "SpscQueue Size must be a power of 2 <= 128.");
+
+    SpscQueue()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    // Can be called from either side although the result may be stale by the time it is used.
+    uint8_t available()
+    {
+        return (uint8_t)(spscQueueLoadAcquire(&m_head) - spscQueueLoadAcquire(&m_tail));
+    }
+
+    bool isEmpty()
+    {
+        return spscQueueLoadAcquire(&m_head) == spscQueueLoadAcquire(&m_tail);
+    }
+
+    bool isFull()
+    {
+        return available() == Size;
+    }
+
+    // Only to be called by the producer.
+    bool push(const ElementType& element)
+    {
+        // Only the producer writes m_head so it doesn't need to be read atomically here.
+        uint8_t head = m_head;
+        if ((uint8_t)(head - spscQueueLoadAcquire(&m_tail)) == Size)
+        {
+            return false;
+        }
+        m_elements[head & (Size - 1)] = element;
+        spscQueueStoreRelease(&m_head, head + 1);
+        return true;
+    }
+
+    // Only to be called by the consumer.
+    bool pop(ElementType& element)
+    {
+        if (!peek(element))
+        {
+            return false;
+        }
+        spscQueueStoreRelease(&m_tail, m_tail + 1);
+        return true;
+    }
+
+    // Only to be called by the consumer.
+    bool peek(ElementType& element)
+    {
+        // Only the consumer writes m_tail so it doesn't need to be read atomically here.
+        uint8_t tail = m_tail;
+        if (spscQueueLoadAcquire(&m_head) == tail)
+        {
+            return false;
+        }
+        element = m_elements[tail & (Size - 1)];
+        return true;
+    }
+
+protected:
+    ElementType      m_elements[Size];
+    volatile uint8_t m_head;
+    volatile uint8_t m_tail;
 };
 
 #endif // QUEUE_H_